@@ -0,0 +1,36 @@
+/*
+    stress benchmark of tree parallel search
+    the policy is a constant-time stub, so selection, expansion and backup dominate
+    usage: mcts_bench [n] [n_playout] [max_threads]
+    run it on two builds to compare how playouts per second scale with threads
+*/
+#include "stub_mcts.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+
+int main(int argc, char *argv[]) {
+    int n = argc > 1 ? std::stoi(argv[1]) : 11;
+    int n_playout = argc > 2 ? std::stoi(argv[2]) : 200000;
+    int max_threads = argc > 3 ? std::stoi(argv[3]) : 32;
+
+    Board board(n, 5);
+    double base = 0;
+    std::cout << "board " << n << "x" << n << ", " << n_playout << " playouts" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(16) << "playouts/s" << std::setw(10) << "speedup" << std::endl;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        StubMCTS mcts(threads, n_playout, 5, 3);
+        mcts.set_early_stop(false); // every playout is timed
+        auto start = std::chrono::steady_clock::now();
+        mcts.get_action(board);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double rate = n_playout / elapsed.count();
+        if (threads == 1) {
+            base = rate;
+        }
+        std::cout << std::setw(8) << threads << std::setw(16) << std::fixed << std::setprecision(0) << rate
+            << std::setw(10) << std::setprecision(2) << rate / base << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+/*
+    micro-benchmarks of the hot paths: board moves, search, the thread pool and inference batching
+    every result is printed as one json object per line, so runs of two versions can be diffed
+    usage: micro_bench [--filter group] [--n 15] [--n_in_row 5] [--max_threads 8]
+                       [--n_playout 20000] [--latency_us 0] [--min_time 0.5] [--model path.pt] [--batch_size 8]
+                       [--layers 2] [--channels 32]
+    the search benchmarks use a stub evaluator whose latency is set by --latency_us
+    the nn benchmarks run --model, or without it a network of random weights with --layers residual blocks
+    of --channels channels on the native backend, so batching is measured with a real forward pass
+*/
+#include "stub_mcts.h"
+#include "random_weights.h"
+#include "board.h"
+#include "symmetry.h"
+#include "rollout.h"
+#include "thread_pool.h"
+#include "neural_network.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+
+struct Options {
+    std::string filter;
+    int n = 15;
+    int n_in_row = 5;
+    int max_threads = 8;
+    int n_playout = 20000;
+    unsigned latency_us = 0;
+    double min_time = 0.5;
+    std::string model;
+    unsigned batch_size = 8;
+    int layers = 2;
+    int channels = 32;
+};
+
+using Params = std::vector<std::pair<std::string, double>>;
+
+// one json line: name, parameters, iterations, seconds and derived rates
+void report(const std::string &name, const Params &params, double iterations, double seconds) {
+    std::ostringstream out;
+    out << std::setprecision(6) << "{\"name\":\"" << name << "\"";
+    for (const auto &param : params) {
+        out << ",\"" << param.first << "\":" << param.second;
+    }
+    out << ",\"iterations\":" << iterations << ",\"seconds\":" << seconds
+        << ",\"ns_per_op\":" << (iterations > 0 ? seconds * 1e9 / iterations : 0.0)
+        << ",\"ops_per_s\":" << (seconds > 0 ? iterations / seconds : 0.0) << "}";
+    std::cout << out.str() << std::endl;
+}
+
+/*
+    repeat f until min_time has passed, f returns the number of operations it ran
+    return (operations, seconds)
+*/
+std::pair<double, double> run_for(double min_time, const std::function<double()> &f) {
+    double ops = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    do {
+        ops += f();
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < min_time);
+    return std::make_pair(ops, elapsed.count());
+}
+
+// random move orders, so move generation does not count towards the board benchmarks
+std::vector<std::vector<int>> random_games(int n, int n_games) {
+    std::mt19937 rng(12345);
+    std::vector<std::vector<int>> games(n_games, std::vector<int>(n * n));
+    for (auto &game : games) {
+        for (int i = 0; i < n * n; ++i) {
+            game[i] = i;
+        }
+        std::shuffle(game.begin(), game.end(), rng);
+    }
+    return games;
+}
+
+void bench_board(const Options &opt) {
+    auto games = random_games(opt.n, 64);
+    Params params{{"n", opt.n}, {"n_in_row", opt.n_in_row}};
+
+    auto res = run_for(opt.min_time, [&]() {
+        double moves = 0;
+        for (const auto &game : games) {
+            Board board(opt.n, opt.n_in_row);
+            for (int pos : game) {
+                board.exec_move(pos);
+                ++moves;
+                if (board.get_result().first) {
+                    break;
+                }
+            }
+        }
+        return moves;
+    });
+    report("board/exec_move", params, res.first, res.second);
+
+    // positions in the middle of a game
+    std::vector<Board> boards;
+    for (const auto &game : games) {
+        Board board(opt.n, opt.n_in_row);
+        for (int i = 0; i < opt.n * opt.n / 4 && !board.get_result().first; ++i) {
+            board.exec_move(game[i]);
+        }
+        boards.push_back(board);
+    }
+    size_t sink = 0;
+    res = run_for(opt.min_time, [&]() {
+        for (const Board &board : boards) {
+            sink += board.get_moves().size();
+        }
+        return static_cast<double>(boards.size());
+    });
+    report("board/get_moves", params, res.first, res.second);
+
+    std::vector<float> planes(4 * opt.n * opt.n);
+    res = run_for(opt.min_time, [&]() {
+        for (const Board &board : boards) {
+            board.encode(planes.data());
+        }
+        return static_cast<double>(boards.size());
+    });
+    report("board/encode", params, res.first, res.second);
+
+    res = run_for(opt.min_time, [&]() {
+        for (const Board &board : boards) {
+            sink += Symmetry::get_canonical_hash(board).second;
+        }
+        return static_cast<double>(boards.size());
+    });
+    report("board/canonical_hash", params, res.first, res.second);
+
+    double result = 0;
+    res = run_for(opt.min_time, [&]() {
+        for (const Board &board : boards) {
+            result += Rollout::simulate(board);
+        }
+        return static_cast<double>(boards.size());
+    });
+    report("board/rollout", params, res.first, res.second);
+    sink += result > 0;
+    if (sink == 1) { // keep the results alive
+        std::cerr << std::endl;
+    }
+}
+
+void bench_search(const Options &opt) {
+    Board board(opt.n, opt.n_in_row);
+    for (int threads = 1; threads <= opt.max_threads; threads *= 2) {
+        Params params{{"n", opt.n}, {"threads", threads}, {"n_playout", opt.n_playout}, {"latency_us", opt.latency_us}};
+        auto res = run_for(opt.min_time, [&]() {
+            StubMCTS mcts(threads, opt.n_playout, 5, 3, opt.latency_us);
+            mcts.set_early_stop(false); // every playout is timed
+            mcts.get_action(board);
+            return static_cast<double>(opt.n_playout);
+        });
+        report("mcts/playout", params, res.first, res.second);
+    }
+}
+
+void bench_thread_pool(const Options &opt) {
+    const size_t n_tasks = 10000;
+    for (int threads = 1; threads <= opt.max_threads; threads *= 2) {
+        Params params{{"threads", threads}};
+        ThreadPool pool(threads);
+        std::atomic<uint64_t> sink{0};
+
+        auto res = run_for(opt.min_time, [&]() {
+            pool.parallel_for(n_tasks, [&sink](size_t i) {
+                sink.fetch_add(i, std::memory_order_relaxed);
+            });
+            return static_cast<double>(n_tasks);
+        });
+        report("thread_pool/parallel_for", params, res.first, res.second);
+
+        res = run_for(opt.min_time, [&]() {
+            std::vector<std::future<void>> futures;
+            futures.reserve(n_tasks);
+            for (size_t i = 0; i < n_tasks; ++i) {
+                futures.emplace_back(pool.commit([&sink, i]() {
+                    sink.fetch_add(i, std::memory_order_relaxed);
+                }));
+            }
+            for (auto &future : futures) {
+                future.wait();
+            }
+            return static_cast<double>(n_tasks);
+        });
+        report("thread_pool/commit", params, res.first, res.second);
+    }
+}
+
+/*
+    threads evaluate random positions through one network
+    besides the rate, the batch sizes actually formed and the queue latency are reported
+*/
+void bench_nn(const Options &opt) {
+    auto games = random_games(opt.n, 256);
+    std::vector<Board> boards;
+    for (const auto &game : games) {
+        Board board(opt.n, opt.n_in_row);
+        for (int i = 0; i < opt.n * opt.n / 4 && !board.get_result().first; ++i) {
+            board.exec_move(game[i]);
+        }
+        boards.push_back(board);
+    }
+    std::string model = opt.model.empty() ? write_random_weights(opt.n, opt.layers, opt.channels) : opt.model;
+    for (int threads = 1; threads <= opt.max_threads; threads *= 2) {
+        NeuralNetwork nn(model, false, opt.batch_size);
+        nn.evaluate(boards[0]).get_value(); // allocate the batch buffers
+        nn.reset_batch_stats();
+        const int per_thread = 64;
+        auto res = run_for(opt.min_time, [&]() {
+            std::vector<std::thread> workers;
+            for (int t = 0; t < threads; ++t) {
+                workers.emplace_back([&, t]() {
+                    for (int i = 0; i < per_thread; ++i) {
+                        nn.evaluate(boards[(t * per_thread + i) % boards.size()]).get_value();
+                    }
+                });
+            }
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            return static_cast<double>(threads * per_thread);
+        });
+        Params params{{"n", opt.n}, {"threads", threads}, {"batch_size", opt.batch_size},
+            {"avg_batch_size", nn.get_avg_batch_size()}, {"queue_latency_us", nn.get_avg_queue_latency_us()}};
+        if (opt.model.empty()) {
+            params.push_back({"layers", opt.layers});
+            params.push_back({"channels", opt.channels});
+        }
+        report("nn/evaluate", params, res.first, res.second);
+    }
+    if (opt.model.empty()) {
+        std::remove(model.c_str());
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string key = argv[i], value = argv[i + 1];
+        if (key == "--filter") opt.filter = value;
+        else if (key == "--n") opt.n = std::stoi(value);
+        else if (key == "--n_in_row") opt.n_in_row = std::stoi(value);
+        else if (key == "--max_threads") opt.max_threads = std::stoi(value);
+        else if (key == "--n_playout") opt.n_playout = std::stoi(value);
+        else if (key == "--latency_us") opt.latency_us = static_cast<unsigned>(std::stoul(value));
+        else if (key == "--min_time") opt.min_time = std::stod(value);
+        else if (key == "--model") opt.model = value;
+        else if (key == "--batch_size") opt.batch_size = static_cast<unsigned>(std::stoul(value));
+        else if (key == "--layers") opt.layers = std::stoi(value);
+        else if (key == "--channels") opt.channels = std::stoi(value);
+        else {
+            std::cerr << "unknown option " << key << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<std::string, std::function<void(const Options&)>>> benches{
+        {"board", bench_board},
+        {"mcts", bench_search},
+        {"thread_pool", bench_thread_pool},
+        {"nn", bench_nn},
+    };
+    for (const auto &bench : benches) {
+        if (opt.filter.empty() || bench.first.find(opt.filter) != std::string::npos) {
+            bench.second(opt);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+    a weights file as written by save_weights in neural_network.py, for the network of neural_network.py
+    with layers residual blocks of channels channels, random convolutions and identity batch norms
+    return its path, a temporary file the caller removes
+    used by micro_bench and by the tests that need a network
+*/
+inline std::string write_random_weights(int n, int layers, int channels) {
+    char path[] = "/tmp/random_weights_XXXXXX.weights";
+    int fd = mkstemps(path, 8);
+    if (fd < 0) {
+        throw std::runtime_error("cannot create a temporary weights file");
+    }
+    close(fd);
+    std::vector<std::pair<std::string, std::vector<uint32_t>>> shapes;
+    auto add_conv = [&](const std::string &conv, const std::string &bn, uint32_t out, uint32_t in, uint32_t kernel) {
+        shapes.push_back({conv + ".weight", {out, in, kernel, kernel}});
+        for (const char *name : {".weight", ".bias", ".running_mean", ".running_var"}) {
+            shapes.push_back({bn + name, {out}});
+        }
+    };
+    auto add_linear = [&](const std::string &name, uint32_t out, uint32_t in) {
+        shapes.push_back({name + ".weight", {out, in}});
+        shapes.push_back({name + ".bias", {out}});
+    };
+    for (int i = 0; i < layers; ++i) {
+        std::string prefix = "res_layers." + std::to_string(i) + ".";
+        uint32_t in = i == 0 ? 4 : channels;
+        add_conv(prefix + "conv1", prefix + "bn1", channels, in, 3);
+        add_conv(prefix + "conv2", prefix + "bn2", channels, channels, 3);
+        if (in != static_cast<uint32_t>(channels)) {
+            add_conv(prefix + "downsample_conv", prefix + "downsample_bn", channels, in, 3);
+        }
+    }
+    uint32_t size = n * n;
+    add_conv("p_conv", "p_bn", 4, channels, 1);
+    add_linear("p_fc", size, 4 * size);
+    add_conv("v_conv", "v_bn", 2, channels, 1);
+    add_linear("v_fc1", 256, 2 * size);
+    add_linear("v_fc2", 1, 256);
+
+    std::mt19937 rng(12345);
+    std::ofstream out(path, std::ios::binary);
+    auto write_u32 = [&](uint32_t x) {
+        out.write(reinterpret_cast<const char*>(&x), sizeof(x));
+    };
+    out.write("AZWEIGHT", 8);
+    write_u32(1);
+    write_u32(static_cast<uint32_t>(shapes.size()));
+    for (const auto &shape : shapes) {
+        const std::string &name = shape.first;
+        write_u32(static_cast<uint32_t>(name.size()));
+        out.write(name.data(), name.size());
+        write_u32(static_cast<uint32_t>(shape.second.size()));
+        size_t count = 1;
+        for (uint32_t dim : shape.second) {
+            write_u32(dim);
+            count *= dim;
+        }
+        // he initialization keeps activations in range through the tower
+        size_t fan_in = shape.second.size() > 1 ? count / shape.second[0] : 1;
+        std::normal_distribution<float> weight(0.0f, std::sqrt(2.0f / fan_in));
+        bool is_bn = name.find("bn") != std::string::npos;
+        bool is_one = is_bn && (name.find(".weight") != std::string::npos || name.find(".running_var") != std::string::npos);
+        bool is_zero = is_bn || name.find(".bias") != std::string::npos;
+        std::vector<float> data(count);
+        for (auto &x : data) {
+            x = is_one ? 1.0f : is_zero ? 0.0f : weight(rng);
+        }
+        out.write(reinterpret_cast<const char*>(data.data()), count * sizeof(float));
+    }
+    if (!out) {
+        std::remove(path);
+        throw std::runtime_error("cannot write the temporary weights file");
+    }
+    return path;
+}
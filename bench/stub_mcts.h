@@ -0,0 +1,33 @@
+#pragma once
+#include "mcts.h"
+#include <random>
+#include <thread>
+#include <chrono>
+
+/*
+    search with a stub evaluator in place of the network
+    uniform priors over the legal moves and a random value, returned after blocking for latency_us
+    as a search thread would while its batch is evaluated
+*/
+class StubMCTS : public MCTS {
+public:
+    StubMCTS(size_t thread_num, int n_playout, double c_puct, double c_virtual_loss, unsigned latency_us = 0) :
+        MCTS(thread_num, n_playout, c_puct, c_virtual_loss), latency_us(latency_us) { }
+
+    std::pair<std::vector<double>, double> policy(Board &board) override {
+        thread_local std::mt19937 rng(std::random_device{}());
+        std::uniform_real_distribution<double> dist(-1.0, 1.0);
+        if (latency_us > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(latency_us));
+        }
+        // normalized like the output of a real network, so selection explores the same way
+        auto actions = board.get_moves();
+        std::vector<double> action_priors(board.get_board_size(), 0.0);
+        for (int action : actions) {
+            action_priors[action] = 1.0 / actions.size();
+        }
+        return std::make_pair(action_priors, dist(rng));
+    }
+private:
+    unsigned latency_us;
+};
@@ -5,10 +5,20 @@ config = {
 
     # mcts config
     'libtorch_use_gpu' : False,                 # libtorch use cuda
+    'native_inference': False,                  # run the network on the native cpu backend instead of libtorch
+    'native_int8': False,                       # int8 residual tower on the native backend
+    'libtorch_cache_size': 50000,               # cached evaluations per network, 0 to disable
+    'libtorch_symmetry_samples': 0,             # average each evaluation over k random symmetries, 0 to disable
     'num_mcts_threads': 4,                      # mcts threads number
     'num_mcts_sims': 1600,                      # mcts simulation times
     'c_puct': 5,                                # puct coeff
     'c_virtual_loss': 3,                        # virtual loss coeff
+    'transposition_table_mb': 16,               # transposition table size per search tree, 0 to disable
+    'mcts_node_budget': 1000000,                # nodes per search tree, 0 for no limit
+    'opening_book': '',                         # self play answers book positions without searching, see test/build_book.py
+    'mcts_early_stop': True,                    # play forced moves at once, stop a greedy search once its move is settled
+    'playout_cap_full_prob': 1.0,               # self play searches a move in full with this probability, 1 to disable
+    'playout_cap_fast_sims': 200,               # simulations of the other moves, their positions are not trained on
 
     # neural_network config
     'train_use_gpu' : False,                    # train neural network using cuda
@@ -26,10 +36,15 @@ config = {
     'num_explore': 20,                          # explore step in a game
     'temp': 1,                                  # temperature
     'dirichlet_alpha': 0.3,                     # action noise in self play games
-    'update_threshold': 0.55,                   # update model threshold
-    'num_contest': 10,                          # new/old model compare times
+    'update_threshold': 0.55,                   # update model threshold if the contest is undecided
+    'num_contest': 20,                          # new/old model compare times at most
+    'contest_opening_moves': 2,                 # random moves before a contest game, each opening is played with both colors
+    'gating_elo0': 0,                           # sprt H0: the new model is this much stronger
+    'gating_elo1': 200,                         # sprt H1: the new model is this much stronger
+    'gating_alpha': 0.1,                        # sprt false accept rate
+    'gating_beta': 0.1,                         # sprt false reject rate
     'check_freq': 20,                           # test model frequency
-    'examples_buffer_max_len': 20,              # max length of examples buffer
+    'replay_buffer_capacity': 20000,            # positions kept for training, sampled under random symmetries
 
     # train debug config
     'show_train_board' : True,                  # show action probs and board states
@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+/*
+    A chunked bump allocator addressed by 32-bit indices
+    blocks never straddle a chunk, so a block of k elements is contiguous
+    allocate() is lock-free and may be called from many search threads
+    clear(), release() and swap() must only be called when no thread is allocating
+    elements are not destroyed individually, T is expected to be re-initialized after allocate()
+*/
+template <class T>
+class Arena {
+public:
+    static constexpr uint32_t null_index = ~0u;
+    static constexpr int chunk_bits = 16;
+    static constexpr uint32_t chunk_size = 1u << chunk_bits;
+    static constexpr uint32_t max_chunks = 4096;
+
+    Arena() : chunks(new std::atomic<T*>[max_chunks]) {
+        for (uint32_t i = 0; i < max_chunks; ++i) {
+            chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~Arena() { release(); }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /*
+        allocate a contiguous block of k elements, 0 < k <= chunk_size
+        return null_index if the arena is exhausted
+    */
+    uint32_t allocate(uint32_t k) {
+        while (true) {
+            uint64_t start = cursor.fetch_add(k, std::memory_order_relaxed);
+            uint64_t end = start + k;
+            if (end > uint64_t(max_chunks) * chunk_size) {
+                return null_index;
+            }
+            if ((start >> chunk_bits) != ((end - 1) >> chunk_bits)) {
+                continue; // the tail of this chunk is wasted
+            }
+            ensure_chunk(static_cast<uint32_t>(start >> chunk_bits));
+            return static_cast<uint32_t>(start);
+        }
+    }
+
+    T &operator[](uint32_t i) {
+        return chunks[i >> chunk_bits].load(std::memory_order_acquire)[i & (chunk_size - 1)];
+    }
+
+    const T &operator[](uint32_t i) const {
+        return chunks[i >> chunk_bits].load(std::memory_order_acquire)[i & (chunk_size - 1)];
+    }
+
+    // number of elements handed out, including wasted chunk tails
+    uint64_t size() const { return cursor.load(std::memory_order_relaxed); }
+
+    // forget all elements in O(1), chunks are kept for reuse
+    void clear() { cursor.store(0, std::memory_order_relaxed); }
+
+    // forget all elements and free the chunks
+    void release() {
+        clear();
+        for (uint32_t i = 0; i < max_chunks; ++i) {
+            delete[] chunks[i].exchange(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    void swap(Arena &other) {
+        chunks.swap(other.chunks);
+        uint64_t tmp = cursor.load(std::memory_order_relaxed);
+        cursor.store(other.cursor.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        other.cursor.store(tmp, std::memory_order_relaxed);
+    }
+private:
+    void ensure_chunk(uint32_t c) {
+        if (chunks[c].load(std::memory_order_acquire) != nullptr) {
+            return;
+        }
+        T *chunk = new T[chunk_size];
+        T *expected = nullptr;
+        if (!chunks[c].compare_exchange_strong(expected, chunk, std::memory_order_acq_rel)) {
+            delete[] chunk; // another thread won the race
+        }
+    }
+
+    std::unique_ptr<std::atomic<T*>[]> chunks;
+    std::atomic<uint64_t> cursor{0};
+};
+
+template <class T> constexpr uint32_t Arena<T>::null_index;
+template <class T> constexpr int Arena<T>::chunk_bits;
+template <class T> constexpr uint32_t Arena<T>::chunk_size;
+template <class T> constexpr uint32_t Arena<T>::max_chunks;
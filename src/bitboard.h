@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+
+/*
+    fixed-size bitset covering boards up to 15x15
+    a board of size n is laid out with a row stride of n + 1, cell (x, y) is bit x * (n + 1) + y
+    the extra column is never set, so shifting a line of stones along
+    a row or a diagonal cannot wrap around into the next row
+*/
+class BitBoard {
+public:
+    static constexpr int n_words = 4;
+    static constexpr int n_bits = 64 * n_words;
+    static constexpr int max_n = 15; // 15 * 16 = 240 bits
+
+    void set(int i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+    void reset(int i) { words[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+    bool test(int i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+
+    bool any() const {
+        return (words[0] | words[1] | words[2] | words[3]) != 0;
+    }
+
+    int count() const {
+        int cnt = 0;
+        for (int i = 0; i < n_words; ++i) {
+            cnt += __builtin_popcountll(words[i]);
+        }
+        return cnt;
+    }
+
+    BitBoard operator&(const BitBoard &other) const {
+        BitBoard res;
+        for (int i = 0; i < n_words; ++i) {
+            res.words[i] = words[i] & other.words[i];
+        }
+        return res;
+    }
+
+    BitBoard operator|(const BitBoard &other) const {
+        BitBoard res;
+        for (int i = 0; i < n_words; ++i) {
+            res.words[i] = words[i] | other.words[i];
+        }
+        return res;
+    }
+
+    // this & ~other
+    BitBoard and_not(const BitBoard &other) const {
+        BitBoard res;
+        for (int i = 0; i < n_words; ++i) {
+            res.words[i] = words[i] & ~other.words[i];
+        }
+        return res;
+    }
+
+    // bit i of the result is bit i + k of this, 0 <= k < n_bits
+    BitBoard operator>>(int k) const {
+        BitBoard res;
+        int word_shift = k >> 6, bit_shift = k & 63;
+        for (int i = 0; i < n_words; ++i) {
+            int j = i + word_shift;
+            uint64_t lo = j < n_words ? words[j] : 0;
+            uint64_t hi = j + 1 < n_words ? words[j + 1] : 0;
+            res.words[i] = bit_shift == 0 ? lo : (lo >> bit_shift) | (hi << (64 - bit_shift));
+        }
+        return res;
+    }
+
+    // bit i + k of the result is bit i of this, 0 <= k < n_bits
+    BitBoard operator<<(int k) const {
+        BitBoard res;
+        int word_shift = k >> 6, bit_shift = k & 63;
+        for (int i = 0; i < n_words; ++i) {
+            int j = i - word_shift;
+            uint64_t hi = j >= 0 ? words[j] : 0;
+            uint64_t lo = j >= 1 ? words[j - 1] : 0;
+            res.words[i] = bit_shift == 0 ? hi : (hi << bit_shift) | (lo >> (64 - bit_shift));
+        }
+        return res;
+    }
+
+    // index of the lowest set bit, -1 if none
+    int lowest() const {
+        for (int i = 0; i < n_words; ++i) {
+            if (words[i]) {
+                return (i << 6) + __builtin_ctzll(words[i]);
+            }
+        }
+        return -1;
+    }
+
+    // call f(i) for each set bit in ascending order
+    template <class F>
+    void for_each(F &&f) const {
+        for (int i = 0; i < n_words; ++i) {
+            uint64_t w = words[i];
+            while (w) {
+                f((i << 6) + __builtin_ctzll(w));
+                w &= w - 1;
+            }
+        }
+    }
+
+    bool operator==(const BitBoard &other) const {
+        for (int i = 0; i < n_words; ++i) {
+            if (words[i] != other.words[i]) return false;
+        }
+        return true;
+    }
+    bool operator!=(const BitBoard &other) const { return !(*this == other); }
+private:
+    uint64_t words[n_words] = {0, 0, 0, 0};
+};
@@ -1,63 +1,144 @@
 #include "board.h"
+#include "board_size.h"
 #include <iostream>
 #include <iomanip>
 #include <utility>
+#include <array>
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+
+static_assert(std::is_trivially_copyable<Board>::value, "Board is copied per playout");
+
+/*
+    mask of on-board cells for each board size
+*/
+static const BitBoard &cell_mask(int n) {
+    static const std::array<BitBoard, BitBoard::max_n + 1> masks = []() {
+        std::array<BitBoard, BitBoard::max_n + 1> res;
+        for (int k = 1; k <= BitBoard::max_n; ++k) {
+            for (int i = 0; i < k; ++i) {
+                for (int j = 0; j < k; ++j) {
+                    res[k].set(i * (k + 1) + j);
+                }
+            }
+        }
+        return res;
+    }();
+    return masks[n];
+}
+
+/*
+    zobrist keys, one per (bit, player) and one for the second player to move
+    generated by splitmix64 with a fixed seed, so hashes are stable across runs
+*/
+static const std::array<uint64_t, 2 * BitBoard::n_bits + 1> &zobrist_keys() {
+    static const std::array<uint64_t, 2 * BitBoard::n_bits + 1> keys = []() {
+        std::array<uint64_t, 2 * BitBoard::n_bits + 1> res;
+        uint64_t seed = 0x9e3779b97f4a7c15ull;
+        for (auto &key : res) {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            key = z ^ (z >> 31);
+        }
+        return res;
+    }();
+    return keys;
+}
+
+uint64_t Board::get_zobrist_key(int bit, int player) {
+    return zobrist_keys()[bit * 2 + (player == 1 ? 0 : 1)];
+}
+
+uint64_t Board::get_zobrist_side_key() {
+    return zobrist_keys()[2 * BitBoard::n_bits];
+}
 
 Board::Board(int n, int n_in_row, int cur_player) :
     n(n), n_in_row(n_in_row), cur_player(cur_player) {
-    states.resize(n, std::vector<int>(n));
+    if (n < 1 || n > BitBoard::max_n) {
+        throw std::invalid_argument("board size must be in [1, 15]");
+    }
+    if (n_in_row < 1 || n_in_row > n) {
+        throw std::invalid_argument("n_in_row must be in [1, board size]");
+    }
+    hash = cur_player == 1 ? 0 : get_zobrist_side_key();
+}
+
+/*
+    whether stones hold k in a row along any line
+    runs of length len are doubled by shift-and-and, then the last partial step overlaps two runs,
+    without early exits, so the steps unroll for a fixed size
+*/
+template <class S>
+static bool has_line(const BitBoard &stones, S size) {
+    const int strides[4] = { // row, column, diagonal, anti-diagonal
+        1, size.n + 1, size.n + 2, size.n
+    };
+    for (int d : strides) {
+        BitBoard run = stones;
+        int len = 1;
+        for (; len * 2 <= size.k; len *= 2) {
+            run = run & (run >> (len * d));
+        }
+        if (len < size.k) {
+            run = run & (run >> ((size.k - len) * d));
+        }
+        if (run.any()) {
+            return true;
+        }
+    }
+    return false;
 }
 
 void Board::exec_move(int pos) {
     return exec_move(pos / n, pos % n);
 }
 
+/*
+    only the mover's stones can form a new line, and the position
+    was not ended before, so any run found must pass through (x, y)
+*/
 void Board::exec_move(int x, int y) {
-    states[x][y] = cur_player;
+    BitBoard &mine = stones[cur_player == 1 ? 0 : 1];
+    int bit = x * (n + 1) + y;
+    mine.set(bit);
+    hash ^= get_zobrist_key(bit, cur_player) ^ get_zobrist_side_key();
+    int player = cur_player;
     cur_player = -cur_player;
     last_move = x * n + y;
     ++move_cnt;
-    const static int dir[4][2] = { // check for four directions
-        {0, 1}, {1, 0}, {1, 1}, {1, -1}
-    };
-    auto is_same = [&](int x, int y, int aim) {
-        return x >= 0 && x < n && y >= 0 && y < n && states[x][y] == aim;
-    };
-    for (int i = 0; i < 4; ++i) {
-        int len = 1, step = 1;
-        while (is_same(x + step * dir[i][0], y + step * dir[i][1], states[x][y])) {
-            ++step, ++len;
-        }
-        step = 1;
-        while (is_same(x - step * dir[i][0], y - step * dir[i][1], states[x][y])) {
-            ++step, ++len;
-        }
-        if (len >= n_in_row) { // if at least n pieces in a row
-            result = std::make_pair(true, states[x][y]);
-            return;
-        }
+    if (dispatch_size(n, n_in_row, [&](auto size) { return has_line(mine, size); })) { // if at least n pieces in a row
+        is_ended = true;
+        winner = player;
+        return;
     }
-    result = {get_is_tie(), 0}; // tie or uncertain
+    is_ended = get_is_tie(); // tie or uncertain
+    winner = 0;
 }
 
 std::vector<int> Board::get_moves() const {
     std::vector<int> moves;
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            if (states[i][j] == 0) {
-                moves.emplace_back(i * n + j); // push available positions in orderj
-            }
-        }
-    }
+    moves.reserve(get_board_size() - move_cnt);
+    dispatch_size(n, n_in_row, [&](auto size) {
+        get_empty().for_each([&](int bit) {
+            moves.emplace_back(bit - bit / (size.n + 1)); // push available positions in order
+        });
+    });
     return moves;
 }
 
+BitBoard Board::get_empty() const {
+    return cell_mask(n).and_not(stones[0] | stones[1]);
+}
+
 bool Board::is_legal(int pos) const {
-    return is_legal(pos / n, pos % n);
+    return pos >= 0 && pos < get_board_size() && is_legal(pos / n, pos % n);
 }
 
 bool Board::is_legal(int x, int y) const {
-    return x >= 0 && x < n && y >= 0 && y < n && states[x][y] == 0;
+    return x >= 0 && x < n && y >= 0 && y < n && get_stone(x, y) == 0;
 }
 
 int Board::get_board_size() const {
@@ -68,6 +149,21 @@ bool Board::get_is_tie() const {
     return move_cnt == get_board_size();
 }
 
+int Board::get_stone(int x, int y) const {
+    int bit = x * (n + 1) + y;
+    return stones[0].test(bit) ? 1 : stones[1].test(bit) ? -1 : 0;
+}
+
+std::vector<std::vector<int>> Board::get_states() const {
+    std::vector<std::vector<int>> states(n, std::vector<int>(n));
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < n; ++j) {
+            states[i][j] = get_stone(i, j);
+        }
+    }
+    return states;
+}
+
 /*
     display the board state using stdout
     the last move is marked in red
@@ -88,7 +184,8 @@ void Board::display() const {
                 std::cout << std::setw(2) << i << "   "; 
             }
             else{
-                char ch = states[i][j] == 0 ? '.' : states[i][j] == 1 ? 'x' : 'o';
+                int stone = get_stone(i, j);
+                char ch = stone == 0 ? '.' : stone == 1 ? 'x' : 'o';
                 if (i == last_x && j == last_y) {
                     std::cout << "\033[31;1m" << ch << "\033[0m" << "   ";
                 }
@@ -109,19 +206,42 @@ void Board::display() const {
     2: board state of the last action
     3: board state of whether takeing the first action
 */
-std::vector<std::vector<std::vector<int>>> Board::get_encode_states() const {
-    std::vector<std::vector<std::vector<int>>> res(
-        4, std::vector<std::vector<int>>(n, std::vector<int>(n)));
-    int is_first = move_cnt % 2 == 0;
-    for (int i = 0; i < n; ++i) {
-        for (int j = 0; j < n; ++j) {
-            if (states[i][j] == 1) res[0][i][j] = 1;
-            else if(states[i][j] == -1) res[1][i][j] = 1;
-            res[3][i][j] = is_first;
+std::vector<float> Board::get_encode_states() const {
+    std::vector<float> res(4 * n * n);
+    encode(res.data());
+    return res;
+}
+
+
+void Board::encode(float *dst) const {
+    dispatch_size(n, n_in_row, [&](auto board_size) {
+        const int stride = board_size.n + 1, size = board_size.n * board_size.n;
+        std::fill(dst, dst + 3 * size, 0.0f);
+        std::fill(dst + 3 * size, dst + 4 * size, move_cnt % 2 == 0 ? 1.0f : 0.0f);
+        stones[0].for_each([&](int bit) {
+            dst[bit - bit / stride] = 1.0f;
+        });
+        stones[1].for_each([&](int bit) {
+            dst[size + bit - bit / stride] = 1.0f;
+        });
+        if (last_move != -1) {
+            dst[2 * size + last_move] = 1.0f;
         }
+    });
+}
+
+void Board::encode_batch(const std::vector<Board> &boards, float *dst, size_t size) {
+    if (boards.empty()) {
+        return;
     }
-    if (last_move != -1) {
-        res[2][last_move / n][last_move % n] = 1;
+    size_t planes = 4 * boards[0].n * boards[0].n;
+    if (size < boards.size() * planes) {
+        throw std::invalid_argument("encode buffer is too small");
     }
-    return res;
-}
\ No newline at end of file
+    for (size_t i = 0; i < boards.size(); ++i) {
+        if (boards[i].n != boards[0].n) {
+            throw std::invalid_argument("boards of a batch must have the same size");
+        }
+        boards[i].encode(dst + i * planes);
+    }
+}
@@ -1,6 +1,14 @@
 #pragma once
+#include "bitboard.h"
 #include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
 
+/*
+    trivially copyable board, one bitboard per player
+    positions passed in and out are always x * n + y
+*/
 class Board {
 public:
     Board(int n, int n_in_row, int cur_player = 1);
@@ -13,22 +21,41 @@ public:
     void display() const;
     int get_board_size() const;
     bool get_is_tie() const;
+    int get_stone(int x, int y) const; // 1/-1/0
 
-    // torch input states
-    std::vector<std::vector<std::vector<int>>> get_encode_states() const;
+    // torch input states, 4 planes of n * n
+    std::vector<float> get_encode_states() const;
+    // write the same 4 * n * n input planes into dst without allocating
+    void encode(float *dst) const;
+    // encode boards[i] at dst + i * 4 * n * n, size is the length of dst, all boards must have the same size
+    static void encode_batch(const std::vector<Board> &boards, float *dst, size_t size);
 
     int get_n() const { return n; }
+    int get_n_in_row() const { return n_in_row; }
     int get_cur_player() const { return cur_player; }
     int get_last_move() const { return last_move; }
     int get_move_cnt() const { return move_cnt; }
-    std::vector<std::vector<int>> get_states() const { return states; }
-    std::pair<bool, int> get_result() const { return result; }
+    std::vector<std::vector<int>> get_states() const;
+    std::pair<bool, int> get_result() const { return {is_ended, winner}; }
+    // zobrist hash of the stones and the player to move, updated incrementally
+    uint64_t get_hash() const { return hash; }
+
+    // bitboard of empty cells, in padded layout
+    BitBoard get_empty() const;
+    const BitBoard &get_stones(int player) const { return stones[player == 1 ? 0 : 1]; }
+    int to_bit(int pos) const { return pos + pos / n; }
+    int to_pos(int bit) const { return bit - bit / (n + 1); }
+
+    static uint64_t get_zobrist_key(int bit, int player);
+    static uint64_t get_zobrist_side_key();
 private:
-    std::vector<std::vector<int>> states;  // board states, -1/1/0
+    BitBoard stones[2];    // stones of the first (1) and second (-1) player
     int n = 15;
     int n_in_row = 5;
     int cur_player = 1;
     int last_move = -1;
     int move_cnt = 0;
-    std::pair<bool, int> result{false, 0}; // (is ended, winner)
-};
\ No newline at end of file
+    bool is_ended = false;
+    int winner = 0;
+    uint64_t hash = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include "bitboard.h"
+
+/*
+    size policies for code written once for all board sizes
+    with FixedSize the board size and run length are compile-time constants, so line strides
+    and bitboard shifts fold into the code and loops over lines and windows are unrolled,
+    RuntimeSize runs the same code for any other size
+*/
+template <int N, int K>
+struct FixedSize {
+    static_assert(N >= 1 && N <= BitBoard::max_n && K >= 1, "invalid board size");
+    static constexpr int n = N;
+    static constexpr int k = K;
+};
+
+struct RuntimeSize {
+    int n;
+    int k;
+};
+
+/*
+    call f with the size policy of an n x n board with k in a row, f is usually a generic lambda
+    only the sizes we train on are instantiated, see config.py and models/
+*/
+template <class F>
+auto dispatch_size(int n, int k, F &&f) -> decltype(f(RuntimeSize{n, k})) {
+    if (k == 5) {
+        switch (n) {
+        case 8: return f(FixedSize<8, 5>());
+        case 11: return f(FixedSize<11, 5>());
+        case 15: return f(FixedSize<15, 5>());
+        }
+    }
+    return f(RuntimeSize{n, k});
+}
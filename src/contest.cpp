@@ -0,0 +1,222 @@
+#include "contest.h"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// expected score of a player elo stronger than its opponent
+double elo_to_score(double elo) {
+    return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+double score_to_elo(double score) {
+    score = std::min(std::max(score, 1e-3), 1.0 - 1e-3);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+}
+
+ContestEngine::ContestEngine(NeuralNetwork *candidate, NeuralNetwork *reference, int n, int n_in_row,
+    size_t n_parallel_games, size_t thread_num, int n_playout, double c_puct, double c_virtual_loss) :
+    candidate(candidate), reference(reference), n(n), n_in_row(n_in_row),
+    n_parallel_games(std::max<size_t>(n_parallel_games, 1)), thread_num(thread_num), n_playout(n_playout),
+    c_puct(c_puct), c_virtual_loss(c_virtual_loss), seed(std::random_device()()) { }
+
+void ContestEngine::set_sprt(double elo0, double elo1, double alpha, double beta) {
+    this->elo0 = elo0;
+    this->elo1 = elo1;
+    this->alpha = alpha;
+    this->beta = beta;
+}
+
+void ContestEngine::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    wins = losses = draws = 0;
+}
+
+int ContestEngine::play(int max_games, bool show) {
+    n_started = 0;
+    decided = get_decision() != 0;
+    if (decided) {
+        return get_decision();
+    }
+    size_t n_threads = std::min<size_t>(n_parallel_games, std::max(max_games, 0));
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < n_threads; ++i) {
+        threads.emplace_back([this, max_games, show]() {
+            AlphaZero candidate_player(candidate, thread_num, n_playout, c_puct, c_virtual_loss);
+            AlphaZero reference_player(reference, thread_num, n_playout, c_puct, c_virtual_loss);
+            for (AlphaZero *player : {&candidate_player, &reference_player}) {
+                player->set_transposition_table_size(transposition_table_mb);
+                player->set_node_budget(node_budget);
+                player->set_early_stop(early_stop);
+            }
+            play_games(candidate_player, reference_player, max_games, show);
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    game_offset += (n_started.load() + 1) / 2 * 2; // whole pairs, so the next call starts with a first game
+    return get_decision();
+}
+
+/*
+    helper function
+    take games from the shared counter until n_games have been started or the test has decided,
+    the second game of a started pair is always taken, so every pair is played with both colors
+    a first game is only counted as started once it is taken, game_offset is even
+*/
+void ContestEngine::play_games(AlphaZero &candidate_player, AlphaZero &reference_player, int n_games, bool show) {
+    while (true) {
+        int k = n_started.load();
+        do {
+            if (k % 2 == 0 && (k >= n_games || decided.load())) {
+                return;
+            }
+        } while (!n_started.compare_exchange_weak(k, k + 1));
+        int game = game_offset + k;
+        int result = play_game(candidate_player, reference_player, get_opening(game / 2), game % 2 == 0, show && k == 0);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++(result == 1 ? wins : result == -1 ? losses : draws);
+        double llr = get_llr();
+        if (llr >= get_llr_upper() || llr <= get_llr_lower()) {
+            decided = true;
+        }
+    }
+}
+
+int ContestEngine::play_game(AlphaZero &candidate_player, AlphaZero &reference_player, const std::vector<int> &opening,
+    bool candidate_first, bool show) {
+    if (show) {
+        std::cout << "display of a contest round begins" << std::endl << std::endl;
+    }
+    Board board(n, n_in_row);
+    candidate_player.update_with_move(-1); // start from empty trees
+    reference_player.update_with_move(-1);
+    for (int action : opening) {
+        board.exec_move(action);
+    }
+    int candidate_color = (opening.size() % 2 == 0) == candidate_first ? 1 : -1;
+
+    while (true) {
+        AlphaZero &player = board.get_cur_player() == candidate_color ? candidate_player : reference_player;
+        int action = player.get_action(board);
+        board.exec_move(action);
+        if (show) {
+            board.display();
+        }
+
+        auto result = board.get_result();
+        if (result.first) {
+            if (show) {
+                std::cout << "display of a contest round finished" << std::endl << std::endl;
+            }
+            return result.second * candidate_color;
+        }
+        candidate_player.update_with_move(action);
+        reference_player.update_with_move(action);
+    }
+}
+
+/*
+    uniformly random moves that do not end the game, the same for every call with the same pair
+*/
+std::vector<int> ContestEngine::get_opening(int pair) const {
+    std::mt19937 rng(seed + static_cast<unsigned>(pair));
+    Board board(n, n_in_row);
+    std::vector<int> opening;
+    for (int i = 0; i < opening_moves; ++i) {
+        auto moves = board.get_moves();
+        if (moves.size() <= 1) {
+            break;
+        }
+        int action = moves[rng() % moves.size()];
+        Board next = board;
+        next.exec_move(action);
+        if (next.get_result().first) {
+            break;
+        }
+        board = next;
+        opening.push_back(action);
+    }
+    return opening;
+}
+
+void ContestEngine::add_results(int wins, int losses, int draws) {
+    if (wins < 0 || losses < 0 || draws < 0) {
+        throw std::invalid_argument("game counts must not be negative");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    this->wins += wins;
+    this->losses += losses;
+    this->draws += draws;
+}
+
+double ContestEngine::get_score() const {
+    int n_games = get_n_games();
+    return n_games > 0 ? (wins + 0.5 * draws) / n_games : 0.5;
+}
+
+/*
+    variance of the score of one game
+    half a win and half a loss are added, so a streak of one result does not make it 0
+*/
+double ContestEngine::get_variance() const {
+    double w = wins + 0.5, l = losses + 0.5, total = w + draws + l;
+    double mean = (w + 0.5 * draws) / total;
+    return (w * (1 - mean) * (1 - mean) + draws * (0.5 - mean) * (0.5 - mean) + l * mean * mean) / total;
+}
+
+/*
+    generalized sprt on the game scores with a normal approximation
+    llr = n * (s1 - s0) * (2 * score - s0 - s1) / (2 * variance), where s0 and s1 are the scores of elo0 and elo1
+*/
+double ContestEngine::get_llr() const {
+    int n_games = get_n_games();
+    if (n_games == 0) {
+        return 0;
+    }
+    double score = get_score();
+    double s0 = elo_to_score(elo0), s1 = elo_to_score(elo1);
+    return n_games * (s1 - s0) * (2 * score - s0 - s1) / (2 * get_variance());
+}
+
+double ContestEngine::get_llr_lower() const {
+    return std::log(beta / (1 - alpha));
+}
+
+double ContestEngine::get_llr_upper() const {
+    return std::log((1 - beta) / alpha);
+}
+
+int ContestEngine::get_decision() const {
+    double llr = get_llr();
+    return llr >= get_llr_upper() ? 1 : llr <= get_llr_lower() ? -1 : 0;
+}
+
+double ContestEngine::get_elo() const {
+    return score_to_elo(get_score());
+}
+
+double ContestEngine::get_elo_lower() const {
+    return get_elo_bound(-1.96);
+}
+
+double ContestEngine::get_elo_upper() const {
+    return get_elo_bound(1.96);
+}
+
+double ContestEngine::get_elo_bound(double z) const {
+    int n_games = get_n_games();
+    if (n_games == 0) {
+        return z < 0 ? -INFINITY : INFINITY;
+    }
+    double score = get_score();
+    return score_to_elo(score + z * std::sqrt(get_variance() / n_games));
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "board.h"
+#include "mcts.h"
+#include "neural_network.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <random>
+
+/*
+    gating games between a candidate and a reference network, many at once
+    games come in pairs that share a random opening, with the candidate moving first in one of them,
+    every game runs on its own thread with one search tree per network
+    a sequential probability ratio test stops the match once accept or reject is settled
+*/
+class ContestEngine {
+public:
+    ContestEngine(NeuralNetwork *candidate, NeuralNetwork *reference, int n, int n_in_row, size_t n_parallel_games,
+        size_t thread_num, int n_playout, double c_puct, double c_virtual_loss);
+
+    void set_transposition_table_size(size_t size_mb) { transposition_table_mb = size_mb; }
+    // nodes per search tree, 0 for no limit, see MCTS::set_node_budget
+    void set_node_budget(size_t max_nodes) { node_budget = max_nodes; }
+    // see MCTS::set_early_stop
+    void set_early_stop(bool early_stop) { this->early_stop = early_stop; }
+    void set_seed(unsigned seed) { this->seed = seed; }
+    // random moves played before the networks take over, the same opening is used by both games of a pair
+    void set_opening_moves(int n_moves) { opening_moves = n_moves; }
+    /*
+        test H0: the candidate is elo0 stronger than the reference, against H1: it is elo1 stronger
+        alpha and beta are the error rates of accepting H1 and H0 wrongly
+    */
+    void set_sprt(double elo0, double elo1, double alpha = 0.05, double beta = 0.05);
+
+    /*
+        play at most max_games more games rounded up to whole pairs, fewer if the test decides first
+        games already running when it decides are finished and counted, with the second game of their pair
+        return 1 if H1 is accepted, -1 if H0 is accepted, 0 if undecided
+        the first game is displayed move by move if show is set
+    */
+    int play(int max_games, bool show = false);
+
+    // count games played elsewhere, e.g. to resume a match, from the view of the candidate
+    void add_results(int wins, int losses, int draws);
+
+    // results from the view of the candidate, over all calls to play
+    int get_wins() const { return wins; }
+    int get_losses() const { return losses; }
+    int get_draws() const { return draws; }
+    int get_n_games() const { return wins + losses + draws; }
+    double get_score() const;
+    // log likelihood ratio of H1 over H0 and its bounds
+    double get_llr() const;
+    double get_llr_lower() const;
+    double get_llr_upper() const;
+    int get_decision() const;
+    // elo difference of the candidate over the reference with a 95% confidence interval
+    double get_elo() const;
+    double get_elo_lower() const;
+    double get_elo_upper() const;
+    void clear();
+private:
+    void play_games(AlphaZero &candidate_player, AlphaZero &reference_player, int n_games, bool show);
+    // return 1/0/-1 from the view of the candidate
+    int play_game(AlphaZero &candidate_player, AlphaZero &reference_player, const std::vector<int> &opening,
+        bool candidate_first, bool show);
+    std::vector<int> get_opening(int pair) const;
+    double get_variance() const;
+    // score + z standard errors, as an elo difference
+    double get_elo_bound(double z) const;
+
+    NeuralNetwork *candidate;
+    NeuralNetwork *reference;
+    int n;
+    int n_in_row;
+    size_t n_parallel_games;
+    size_t thread_num;
+    int n_playout;
+    double c_puct;
+    double c_virtual_loss;
+    size_t transposition_table_mb = 0;
+    size_t node_budget = 0;
+    bool early_stop = true;
+    int opening_moves = 2;
+    double elo0 = 0;
+    double elo1 = 35;     // about a 55% score
+    double alpha = 0.05;
+    double beta = 0.05;
+    unsigned seed;
+
+    std::atomic<int> n_started{0};   // games handed out in the current play()
+    std::atomic<bool> decided{false};
+    int game_offset = 0;             // games of earlier calls, so openings are not replayed
+    mutable std::mutex mutex;        // guards the results below
+    int wins = 0;
+    int losses = 0;
+    int draws = 0;
+};
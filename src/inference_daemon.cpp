@@ -0,0 +1,344 @@
+#include "inference_daemon.h"
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <random>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static_assert(std::is_trivially_copyable<Board>::value, "boards are copied through shared memory");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex words must be plain 32-bit atomics");
+
+namespace {
+
+enum : uint32_t { slot_free, slot_claimed, slot_submitted, slot_running, slot_done };
+
+constexpr char magic[8] = {'A', 'Z', 'I', 'N', 'F', 'E', 'R', '1'};
+
+constexpr size_t round_up(size_t size) {
+    return (size + 63) / 64 * 64;
+}
+
+struct Header {
+    char magic[8];
+    uint32_t board_bytes;               // sizeof(Board) of the daemon
+    uint32_t n;
+    uint32_t n_slots;
+    uint32_t slot_size;
+    std::atomic<uint32_t> requests;     // bumped on every submission, the daemon sleeps on it
+    std::atomic<uint32_t> daemon_waiting;
+    std::atomic<uint32_t> releases;     // bumped when a slot is freed, clients without a slot sleep on it
+    std::atomic<uint32_t> slot_waiters;
+    std::atomic<uint32_t> alive;
+    int32_t daemon_pid;                 // clients give up once it is gone, alive stays set after a crash
+};
+
+struct Slot {
+    std::atomic<uint32_t> state;
+    std::atomic<int32_t> owner;         // pid of the client holding the slot, 0 if it is free
+    float value;
+    alignas(8) unsigned char board[sizeof(Board)];
+    // float prob[n * n] follows
+};
+
+// futex words live in memory shared between processes, so the non-private operations are used
+void futex_wait(std::atomic<uint32_t> *addr, uint32_t expected, long timeout_ms) {
+    timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t> *addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+// pids are only meaningful within one pid namespace, which processes sharing /dev/shm normally are
+bool process_alive(int32_t pid) {
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+}
+
+}
+
+/*
+    a mapping of the segment, created by the daemon and opened by clients
+*/
+class SharedSegment {
+public:
+    SharedSegment(const std::string &name, int n, unsigned n_slots) : name("/" + name), owner(true) {
+        if (n < 1 || n > BitBoard::max_n || n_slots == 0) {
+            throw std::invalid_argument("invalid board size or slot count for inference segment " + name);
+        }
+        size_t slot_size = round_up(sizeof(Slot) + n * n * sizeof(float));
+        size = round_up(sizeof(Header)) + n_slots * slot_size;
+        shm_unlink(this->name.c_str()); // a segment left by a crashed daemon
+        int fd = shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 || ftruncate(fd, size) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("cannot create inference segment " + name);
+        }
+        map(fd);
+        Header *h = header;
+        std::memcpy(h->magic, magic, sizeof(magic));
+        h->board_bytes = sizeof(Board);
+        h->n = n;
+        h->n_slots = n_slots;
+        h->slot_size = static_cast<uint32_t>(slot_size);
+        h->daemon_pid = static_cast<int32_t>(getpid());
+        for (unsigned i = 0; i < n_slots; ++i) {
+            get_slot(i)->state.store(slot_free);
+            get_slot(i)->owner.store(0);
+        }
+        h->alive.store(1); // last, clients check it
+    }
+
+    explicit SharedSegment(const std::string &name) : name("/" + name), owner(false) {
+        int fd = shm_open(this->name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("no inference daemon serves " + name);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw std::runtime_error("cannot stat inference segment " + name);
+        }
+        size = st.st_size;
+        if (size < round_up(sizeof(Header))) {
+            close(fd);
+            throw std::runtime_error("inference segment " + name + " is not initialized");
+        }
+        map(fd);
+        if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 || header->board_bytes != sizeof(Board)
+            || header->alive.load() == 0 || !process_alive(header->daemon_pid)) {
+            munmap(header, size);
+            throw std::runtime_error("inference segment " + name + " belongs to another build or a stopped daemon");
+        }
+        // the slots must lie within the mapping before get_slot touches them
+        int n = static_cast<int>(header->n);
+        if (n < 1 || n > BitBoard::max_n || header->n_slots == 0
+            || header->slot_size < round_up(sizeof(Slot) + n * n * sizeof(float))
+            || size < round_up(sizeof(Header)) + static_cast<size_t>(header->n_slots) * header->slot_size) {
+            munmap(header, size);
+            throw std::runtime_error("inference segment " + name + " is truncated or corrupt");
+        }
+    }
+
+    ~SharedSegment() {
+        if (owner) {
+            header->alive.store(0);
+            shm_unlink(name.c_str());
+        }
+        munmap(header, size);
+    }
+
+    Slot *get_slot(unsigned i) const {
+        return reinterpret_cast<Slot*>(reinterpret_cast<unsigned char*>(header) + round_up(sizeof(Header))
+            + static_cast<size_t>(i) * header->slot_size);
+    }
+    float *get_prob(unsigned i) const { return reinterpret_cast<float*>(get_slot(i) + 1); }
+    // whether the daemon that created the segment is still serving it
+    bool get_is_served() const { return header->alive.load() != 0 && process_alive(header->daemon_pid); }
+
+    Header *header = nullptr;
+private:
+    void map(int fd) {
+        void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("cannot map inference segment " + name);
+        }
+        header = static_cast<Header*>(addr);
+    }
+
+    std::string name;
+    bool owner;
+    size_t size = 0;
+};
+
+InferenceDaemon::InferenceDaemon(std::string name, std::string model_path, bool use_gpu, int n, unsigned batch_size,
+    size_t cache_size, unsigned n_slots) :
+    segment(new SharedSegment(name, n, n_slots)), network(model_path, use_gpu, batch_size, cache_size) {
+    dispatcher = std::thread([this]() { dispatch(); });
+    completer = std::thread([this]() { complete(); });
+}
+
+InferenceDaemon::~InferenceDaemon() {
+    stop.store(true);
+    futex_wake(&segment->header->requests, 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+    }
+    cv.notify_all();
+    dispatcher.join();
+    completer.join();
+}
+
+/*
+    daemon_waiting is set before requests is compared, and clients bump requests before they read daemon_waiting,
+    so either the dispatcher sees the new request or the client wakes it, futex_wait rechecks requests atomically
+*/
+void InferenceDaemon::dispatch() {
+    Header *header = segment->header;
+    auto last_reclaim = std::chrono::steady_clock::now();
+    while (!stop.load()) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_reclaim >= std::chrono::seconds(1)) {
+            reclaim();
+            last_reclaim = now;
+        }
+        uint32_t seen = header->requests.load();
+        unsigned found = 0;
+        for (unsigned i = 0; i < header->n_slots; ++i) {
+            Slot *slot = segment->get_slot(i);
+            uint32_t expected = slot_submitted;
+            if (slot->state.load(std::memory_order_relaxed) != slot_submitted
+                || !slot->state.compare_exchange_strong(expected, slot_running)) {
+                continue;
+            }
+            Board board = *reinterpret_cast<const Board*>(slot->board);
+            auto evaluation = network.evaluate(board);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.emplace_back(i, std::move(evaluation));
+            }
+            cv.notify_one();
+            ++found;
+        }
+        if (found == 0) {
+            header->daemon_waiting.store(1);
+            if (header->requests.load() == seen && !stop.load()) {
+                futex_wait(&header->requests, seen, 100);
+            }
+            header->daemon_waiting.store(0);
+        }
+    }
+}
+
+/*
+    free the slots of clients that died while holding them
+    a running slot is left to complete, which marks it done, so it is freed by a later call
+    the state is swapped with compare_exchange, so a slot the dispatcher takes at the same time is skipped
+*/
+void InferenceDaemon::reclaim() {
+    Header *header = segment->header;
+    unsigned n_reclaimed = 0;
+    for (unsigned i = 0; i < header->n_slots; ++i) {
+        Slot *slot = segment->get_slot(i);
+        int32_t owner = slot->owner.load();
+        if (owner == 0 || process_alive(owner)) {
+            continue;
+        }
+        uint32_t state = slot->state.load();
+        if (state == slot_running || !slot->state.compare_exchange_strong(state, slot_free)) {
+            continue;
+        }
+        slot->owner.store(0);
+        ++n_reclaimed;
+    }
+    if (n_reclaimed > 0) {
+        header->releases.fetch_add(1);
+        futex_wake(&header->releases, INT_MAX);
+    }
+}
+
+void InferenceDaemon::complete() {
+    int size = static_cast<int>(segment->header->n * segment->header->n);
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() {
+            return !pending.empty() || stop.load();
+        });
+        if (pending.empty()) {
+            return;
+        }
+        auto item = std::move(pending.front());
+        pending.pop_front();
+        lock.unlock();
+
+        Slot *slot = segment->get_slot(item.first);
+        const float *prob = item.second.get_prob();
+        std::copy(prob, prob + size, segment->get_prob(item.first));
+        slot->value = item.second.get_value();
+        slot->state.store(slot_done);
+        futex_wake(&slot->state, 1);
+    }
+}
+
+InferenceClient::InferenceClient(std::string name) : segment(new SharedSegment(name)) { }
+
+InferenceClient::~InferenceClient() = default;
+
+int InferenceClient::get_n() const {
+    return static_cast<int>(segment->header->n);
+}
+
+void InferenceClient::evaluate(const Board &board, std::vector<float> &prob, float &value) {
+    Header *header = segment->header;
+    if (board.get_n() != static_cast<int>(header->n)) {
+        throw std::invalid_argument("the inference daemon serves another board size");
+    }
+    /*
+        claim a free slot, starting at a random one so threads rarely collide
+        the owner is the claim, so a slot always names the process to reclaim it from
+    */
+    thread_local std::mt19937 rng(std::random_device{}());
+    unsigned n_slots = header->n_slots, start = rng() % n_slots, i = 0;
+    int32_t pid = static_cast<int32_t>(getpid());
+    Slot *slot = nullptr;
+    while (slot == nullptr) {
+        uint32_t releases = header->releases.load();
+        for (unsigned k = 0; k < n_slots; ++k) {
+            i = (start + k) % n_slots;
+            int32_t expected = 0;
+            if (segment->get_slot(i)->owner.compare_exchange_strong(expected, pid)) {
+                slot = segment->get_slot(i);
+                slot->state.store(slot_claimed);
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            if (!segment->get_is_served()) {
+                throw std::runtime_error("the inference daemon stopped");
+            }
+            header->slot_waiters.fetch_add(1);
+            futex_wait(&header->releases, releases, 100);
+            header->slot_waiters.fetch_sub(1);
+        }
+    }
+
+    std::memcpy(slot->board, &board, sizeof(Board));
+    slot->state.store(slot_submitted);
+    header->requests.fetch_add(1);
+    if (header->daemon_waiting.load()) {
+        futex_wake(&header->requests, 1);
+    }
+
+    uint32_t state;
+    while ((state = slot->state.load()) != slot_done) {
+        if (!segment->get_is_served()) {
+            throw std::runtime_error("the inference daemon stopped");
+        }
+        futex_wait(&slot->state, state, 100);
+    }
+    int size = board.get_board_size();
+    const float *res = segment->get_prob(i);
+    prob.assign(res, res + size);
+    value = slot->value;
+
+    slot->state.store(slot_free);
+    slot->owner.store(0); // last, the slot can be claimed from here on
+    header->releases.fetch_add(1);
+    if (header->slot_waiters.load() > 0) {
+        futex_wake(&header->releases, 1);
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "board.h"
+#include "neural_network.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+/*
+    one network shared by the processes of a host through posix shared memory
+    a client copies its board into a free slot of the segment and sleeps on a futex in that slot,
+    the daemon hands every submitted board to its NeuralNetwork, so boards of all processes are
+    batched and cached together, and wakes the client once the result is written back
+
+    segment layout: Header, then n_slots slots of
+        atomic<uint32_t> state    free -> claimed -> submitted -> running -> done -> free
+        atomic<int32_t> owner     pid of the client holding the slot, 0 if free
+        float value
+        Board board               Board is trivially copyable
+        float prob[n * n]
+    both sides must be built from the same sources, the header records sizeof(Board) to check it
+
+    the daemon frees the slots of clients that died holding them, and clients throw once
+    the daemon process is gone, so a crash on either side does not block the other
+*/
+class SharedSegment;
+
+class InferenceDaemon {
+public:
+    // create the segment /name and serve it with the model at model_path, see NeuralNetwork
+    InferenceDaemon(std::string name, std::string model_path, bool use_gpu, int n, unsigned batch_size,
+        size_t cache_size = 0, unsigned n_slots = 256);
+    ~InferenceDaemon();
+
+    InferenceDaemon(const InferenceDaemon &) = delete;
+    InferenceDaemon &operator=(const InferenceDaemon &) = delete;
+
+    // the network behind the daemon, for settings, statistics and load_model
+    NeuralNetwork &get_network() { return network; }
+private:
+    // move submitted boards into the network without waiting for results
+    void dispatch();
+    // write results back in submission order and wake their clients
+    void complete();
+    // free the slots of dead clients
+    void reclaim();
+
+    std::unique_ptr<SharedSegment> segment;
+    NeuralNetwork network;
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::pair<unsigned, NeuralNetwork::Evaluation>> pending;  // slot, evaluation
+    std::thread dispatcher;
+    std::thread completer;
+};
+
+/*
+    client end of an InferenceDaemon, used by NeuralNetwork for a model path "shm:name"
+    evaluate may be called from many threads, each call takes one slot until its result is back
+*/
+class InferenceClient {
+public:
+    explicit InferenceClient(std::string name);
+    ~InferenceClient();
+
+    InferenceClient(const InferenceClient &) = delete;
+    InferenceClient &operator=(const InferenceClient &) = delete;
+
+    // block until the daemon has evaluated board
+    void evaluate(const Board &board, std::vector<float> &prob, float &value);
+    int get_n() const;
+private:
+    std::unique_ptr<SharedSegment> segment;
+};
@@ -4,15 +4,145 @@
 #include "mcts.h"
 #include "board.h"
 #include "neural_network.h"
+#include "symmetry.h"
+#include "self_play.h"
+#include "contest.h"
+#include "replay_buffer.h"
+#include "opening_book.h"
+#include "inference_daemon.h"
+
+#define SWIG_FILE_WITH_INIT
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+#include <stdexcept>
+#include <cstring>
+
+template <typename T> struct NumpyType;
+template <> struct NumpyType<int> { enum { value = NPY_INT }; };
+template <> struct NumpyType<float> { enum { value = NPY_FLOAT }; };
+template <> struct NumpyType<double> { enum { value = NPY_DOUBLE }; };
+
+template <typename T>
+void release_vector(PyObject *capsule) {
+    delete static_cast<std::vector<T>*>(PyCapsule_GetPointer(capsule, nullptr));
+}
+
+/*
+    array with its own copy of a vector held by the c++ object, the object may refill or
+    reallocate the vector at any later call, so the array cannot point into it
+*/
+template <typename T>
+PyObject *numpy_copy(const std::vector<T> &data) {
+    npy_intp size = data.size();
+    PyObject *array = PyArray_SimpleNew(1, &size, NumpyType<T>::value);
+    if (array != nullptr && size > 0) {
+        std::memcpy(PyArray_DATA(reinterpret_cast<PyArrayObject*>(array)), data.data(), size * sizeof(T));
+    }
+    return array;
+}
+
+/* array that takes over the storage of a returned vector */
+template <typename T>
+PyObject *numpy_take(std::vector<T> &&data) {
+    npy_intp size = data.size();
+    if (size == 0) {
+        return PyArray_SimpleNew(1, &size, NumpyType<T>::value);
+    }
+    auto *storage = new std::vector<T>(std::move(data));
+    PyObject *capsule = PyCapsule_New(storage, nullptr, release_vector<T>);
+    if (capsule == nullptr) {
+        delete storage;
+        return nullptr;
+    }
+    PyObject *array = PyArray_New(&PyArray_Type, 1, &size, NumpyType<T>::value, nullptr,
+        storage->data(), 0, NPY_ARRAY_CARRAY, nullptr);
+    if (array == nullptr) {
+        Py_DECREF(capsule);
+        return nullptr;
+    }
+    PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(array), capsule);
+    return array;
+}
 %}
 
+%init %{
+    import_array();
+%}
+
+%include "exception.i"
+%exception {
+    try {
+        $action
+    }
+    catch (const std::invalid_argument &e) {
+        SWIG_exception(SWIG_ValueError, e.what());
+    }
+    catch (const std::exception &e) {
+        SWIG_exception(SWIG_RuntimeError, e.what());
+    }
+}
+
 %include "std_vector.i"
 namespace std {
     %template(IntVector) vector<int>;
-    %template(IntVectorVector) vector<vector<int>>;
+    %template(IntVectorVector) vector<vector<int>>;  // Board::get_states
+    %template(FloatVector) vector<float>;
     %template(DoubleVector) vector<double>;
-    %template(DoubleVectorVector) vector<vector<double>>;
-    %template(IntVectorVectorVector) vector<vector<vector<int>>>;
+}
+
+/*
+    numpy arrays instead of tuples for flat vectors
+    vectors returned by value hand their storage to the array, vectors returned by reference are copied
+*/
+%typemap(out) std::vector<int>, std::vector<float>, std::vector<double> {
+    $result = numpy_take(std::move(static_cast<$1_ltype &>($1)));
+    if ($result == nullptr) SWIG_fail;
+}
+%typemap(out) const std::vector<int> &, const std::vector<float> & {
+    $result = numpy_copy(*$1);
+    if ($result == nullptr) SWIG_fail;
+}
+
+// any float array-like, copied once in c++
+%typemap(in) const std::vector<float> & (std::vector<float> temp) {
+    PyArrayObject *array = reinterpret_cast<PyArrayObject*>(PyArray_FROMANY($input, NPY_FLOAT, 0, 0, NPY_ARRAY_IN_ARRAY | NPY_ARRAY_FORCECAST));
+    if (array == nullptr) SWIG_fail;
+    const float *data = static_cast<const float*>(PyArray_DATA(array));
+    temp.assign(data, data + PyArray_SIZE(array));
+    Py_DECREF(array);
+    $1 = &temp;
+}
+%typemap(typecheck, precedence=SWIG_TYPECHECK_FLOAT_ARRAY) const std::vector<float> & {
+    $1 = PyArray_Check($input) || PySequence_Check($input) ? 1 : 0;
+}
+%typemap(freearg) const std::vector<float> & ""
+
+// a sequence of boards, copied
+%typemap(in) const std::vector<Board> & (std::vector<Board> temp) {
+    PyObject *seq = PySequence_Fast($input, "expected a sequence of boards");
+    if (seq == nullptr) SWIG_fail;
+    Py_ssize_t n_boards = PySequence_Fast_GET_SIZE(seq);
+    temp.reserve(n_boards);
+    for (Py_ssize_t i = 0; i < n_boards; ++i) {
+        Board *board = nullptr;
+        if (!SWIG_IsOK(SWIG_ConvertPtr(PySequence_Fast_GET_ITEM(seq, i), reinterpret_cast<void**>(&board), $descriptor(Board *), 0))) {
+            Py_DECREF(seq);
+            SWIG_exception_fail(SWIG_TypeError, "expected a sequence of boards");
+        }
+        temp.push_back(*board);
+    }
+    Py_DECREF(seq);
+    $1 = &temp;
+}
+
+// a caller-provided output array, written in place
+%typemap(in) (float *dst, size_t size) {
+    PyArrayObject *array = reinterpret_cast<PyArrayObject*>($input);
+    if (!PyArray_Check($input) || PyArray_TYPE(array) != NPY_FLOAT || !PyArray_ISCARRAY(array)) {
+        SWIG_exception_fail(SWIG_TypeError, "expected a writable c-contiguous float32 array");
+    }
+    $1 = static_cast<float*>(PyArray_DATA(array));
+    $2 = PyArray_SIZE(array);
 }
 
 %include "std_pair.i"
@@ -23,12 +153,61 @@ namespace std {
 
 %include "std_string.i"
 
+%include "std_map.i"
+namespace std {
+    %template(StringDoubleMap) map<string, double>;
+}
+
+%include "opening_book.h"
 %include "mcts.h"
+
+%ignore Board::encode;
+%pythonappend Board::get_encode_states %{
+    val = val.reshape(4, self.get_n(), self.get_n())
+%}
 %include "board.h"
 
+class InferenceServer {
+public:
+    InferenceServer();
+    ~InferenceServer();
+};
+
 class NeuralNetwork {
 public:
-    NeuralNetwork(std::string model_path, bool use_gpu, unsigned batch_size);
+    NeuralNetwork(std::string model_path, bool use_gpu, unsigned batch_size, size_t cache_size = 0,
+        InferenceServer *server = nullptr);
     ~NeuralNetwork();
     void set_batch_size(unsigned batch_size);
-};
\ No newline at end of file
+    void set_max_wait_us(unsigned max_wait_us);
+    void set_symmetry_samples(unsigned k);
+    void set_priority(double priority);
+    double get_avg_batch_size() const;
+    double get_batch_fill_ratio() const;
+    double get_avg_queue_latency_us() const;
+    void reset_batch_stats();
+    std::map<std::string, double> get_stats() const;
+    void reset_stats();
+    void load_model(std::string model_path);
+    void set_quantized(bool quantized);
+    void set_cache_size(size_t cache_size);
+    unsigned long long get_cache_hits() const;
+    unsigned long long get_cache_misses() const;
+};
+
+class Symmetry {
+public:
+    static std::vector<float> augment(int n, int n_planes, const std::vector<float> &data);
+};
+
+%include "self_play.h"
+%include "contest.h"
+%include "replay_buffer.h"
+
+class InferenceDaemon {
+public:
+    InferenceDaemon(std::string name, std::string model_path, bool use_gpu, int n, unsigned batch_size,
+        size_t cache_size = 0, unsigned n_slots = 256);
+    ~InferenceDaemon();
+    NeuralNetwork &get_network();
+};
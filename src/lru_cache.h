@@ -0,0 +1,97 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+
+/*
+    A sharded LRU cache keyed by 64-bit hashes
+    each shard has its own mutex, list and index, so threads rarely contend
+    the capacity is split evenly over the shards
+*/
+template <class Value>
+class LRUCache {
+public:
+    LRUCache(size_t capacity, size_t n_shards = 16) : capacity(capacity) {
+        for (size_t i = 0; i < n_shards; ++i) {
+            shards.emplace_back(new Shard());
+            shards.back()->capacity = (capacity + n_shards - 1) / n_shards;
+        }
+    }
+
+    // copy the value out on a hit, and mark it as most recently used
+    bool get(uint64_t key, Value &value) {
+        Shard &shard = get_shard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            ++misses;
+            return false;
+        }
+        shard.items.splice(shard.items.begin(), shard.items, it->second);
+        value = it->second->second;
+        ++hits;
+        return true;
+    }
+
+    void put(uint64_t key, Value value) {
+        Shard &shard = get_shard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.capacity == 0) {
+            return;
+        }
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            it->second->second = std::move(value);
+            shard.items.splice(shard.items.begin(), shard.items, it->second);
+            return;
+        }
+        if (shard.items.size() >= shard.capacity) { // evict the least recently used
+            shard.index.erase(shard.items.back().first);
+            shard.items.pop_back();
+        }
+        shard.items.emplace_front(key, std::move(value));
+        shard.index.emplace(key, shard.items.begin());
+    }
+
+    void clear() {
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->items.clear();
+            shard->index.clear();
+        }
+    }
+
+    size_t size() const {
+        size_t res = 0;
+        for (const auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            res += shard->items.size();
+        }
+        return res;
+    }
+
+    size_t get_capacity() const { return capacity; }
+    uint64_t get_hits() const { return hits.load(); }
+    uint64_t get_misses() const { return misses.load(); }
+    void reset_counters() { hits.store(0); misses.store(0); }
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<std::pair<uint64_t, Value>> items; // front is the most recently used
+        std::unordered_map<uint64_t, typename std::list<std::pair<uint64_t, Value>>::iterator> index;
+        size_t capacity;
+    };
+
+    // the low bits pick a bucket inside the shard's map, so use the high bits here
+    Shard &get_shard(uint64_t key) { return *shards[(key >> 48) % shards.size()]; }
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t capacity;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+};
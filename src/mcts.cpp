@@ -1,4 +1,6 @@
 #include "mcts.h"
+#include "rollout.h"
+#include "reclaimer.h"
 #include <iostream>
 #include <cfloat>
 #include <cmath>
@@ -6,135 +8,583 @@
 #include <utility>
 #include <random>
 #include <future>
+#include <chrono>
+#include <unordered_map>
+#include <queue>
+#include <stdexcept>
 
-Node::Node(Node *parent = nullptr, double p_sa = 1.0, int action = -1) : 
-    parent(parent), p_sa(p_sa), action(action) { }
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MCTS_SELECT_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr int select_lanes = 8;
+constexpr int max_select_children = (BitBoard::max_n * BitBoard::max_n + select_lanes - 1) / select_lanes * select_lanes;
 
 /*
-    expand a leaf node
-    param action is all legal actions can be taken
+    children unpacked into float arrays for one selection, padded to a multiple of select_lanes
+    score = q / max(n, 1) + c * p / (1 + n), where q is 0 for unvisited children and
+    c is c_puct * sqrt(parent visits), the padding scores -FLT_MAX
 */
-void Node::expand(const std::vector<double> &action_priors, const std::vector<int> &actions) {
-    if (!is_parent.exchange(true)) { // if not been expanded
-        children.reserve(actions.size()); 
-        for (const auto &action : actions) {
-            children.emplace_back(new Node(this, action_priors[action], action));
+struct SelectInput {
+    alignas(32) float p[max_select_children];
+    alignas(32) float q[max_select_children];
+    alignas(32) float n[max_select_children];
+};
+
+// index of the first child with the highest score
+int select_best_generic(const SelectInput &in, int count, float c) {
+    int best = 0;
+    float best_score = -FLT_MAX;
+    for (int i = 0; i < count; ++i) {
+        float score = in.q[i] / std::max(in.n[i], 1.0f) + c * in.p[i] / (1.0f + in.n[i]);
+        if (score > best_score) {
+            best_score = score;
+            best = i;
+        }
+    }
+    return best;
+}
+
+#ifdef MCTS_SELECT_AVX2
+bool has_avx2() {
+    static const bool res = __builtin_cpu_supports("avx2");
+    return res;
+}
+
+// every lane keeps its first maximum, the lowest index among the lanes with the overall maximum wins
+__attribute__((target("avx2")))
+int select_best_avx2(const SelectInput &in, int count, float c) {
+    const __m256 one = _mm256_set1_ps(1.0f), cv = _mm256_set1_ps(c);
+    __m256 best = _mm256_set1_ps(-FLT_MAX);
+    __m256i best_index = _mm256_setzero_si256();
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(select_lanes);
+    for (int i = 0; i < count; i += select_lanes) {
+        __m256 n = _mm256_load_ps(in.n + i);
+        __m256 q = _mm256_div_ps(_mm256_load_ps(in.q + i), _mm256_max_ps(n, one));
+        __m256 u = _mm256_div_ps(_mm256_mul_ps(cv, _mm256_load_ps(in.p + i)), _mm256_add_ps(one, n));
+        __m256 score = _mm256_add_ps(q, u);
+        __m256 greater = _mm256_cmp_ps(score, best, _CMP_GT_OQ);
+        best = _mm256_blendv_ps(best, score, greater);
+        best_index = _mm256_blendv_epi8(best_index, index, _mm256_castps_si256(greater));
+        index = _mm256_add_epi32(index, step);
+    }
+    alignas(32) float scores[select_lanes];
+    alignas(32) int indices[select_lanes];
+    _mm256_store_ps(scores, best);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(indices), best_index);
+    int res = indices[0];
+    float res_score = scores[0];
+    for (int k = 1; k < select_lanes; ++k) {
+        if (scores[k] > res_score || (scores[k] == res_score && indices[k] < res)) {
+            res_score = scores[k];
+            res = indices[k];
         }
-        is_leaf.store(false); // expand finished
     }
+    return res;
+}
+#endif
+
 }
 
+void Node::init(int action, double p_sa) {
+    this->children = NodeArena::null_index;
+    this->n_children = 0;
+    this->action = static_cast<int16_t>(action);
+    this->p_sa = static_cast<float>(p_sa);
+    virtual_loss.store(0, std::memory_order_relaxed);
+    state.store(leaf, std::memory_order_relaxed);
+    stats.store(0, std::memory_order_relaxed);
+}
+
+constexpr int Node::w_bits;
+constexpr double Node::w_scale;
+
 /*
-    propagate value from leaf to root
-    update n_visit and q_sa 
+    one more visit with the given value, as an addend to the packed stats
+    a negative value borrows from the n_visit bits, which unpack_n_visit undoes
 */
-void Node::backup(double value) {
-    if (parent != nullptr) {
-        parent->backup(-value); // -value for the opposite player
-    }
-    --virtual_loss;
-    unsigned n_visit = ++this->n_visit;
+uint64_t Node::pack_delta(double value) {
+    return (uint64_t(1) << w_bits) + uint64_t(std::llround(value * w_scale));
+}
 
-    // simple mutex, have not consider the consistency of q_sa and n_visit
-    // the side effect can be ignored
-    { 
-        std::lock_guard<std::mutex> lock(mutex_val);
-        q_sa = ((n_visit - 1) * q_sa + value) / n_visit;
+/*
+    expand a leaf node
+    param action is all legal actions can be taken
+    all children are allocated as one block, return false if the arena is exhausted
+*/
+bool Node::expand(NodeArena &arena, const std::vector<double> &action_priors, const std::vector<int> &actions) {
+    uint8_t expected = leaf;
+    if (!state.compare_exchange_strong(expected, expanding)) { // been expanded by others
+        return true;
+    }
+    uint32_t block = arena.allocate(actions.size());
+    if (block == NodeArena::null_index) {
+        state.store(leaf, std::memory_order_release);
+        return false;
     }
+    Node *first = &arena[block];
+    for (size_t i = 0; i < actions.size(); ++i) {
+        first[i].init(actions[i], action_priors[actions[i]]);
+    }
+    children = block;
+    n_children = static_cast<uint16_t>(actions.size());
+    state.store(expanded, std::memory_order_release); // expand finished
+    return true;
 }
 
 /*
-    select the next action
+    share the children of an expanded node of the same position
+    return false if this node is not a leaf any more
 */
-Node* Node::select(double c_puct, double c_virtual_loss) {
-    auto res = *max_element(children.begin(), children.end(), 
-        [&](const Node *a, const Node *b) {
-            return a->get_value(c_puct, c_virtual_loss) < b->get_value(c_puct, c_virtual_loss);
-        }); 
-    ++res->virtual_loss;
-    return res;
+bool Node::link(const Node &other) {
+    uint8_t expected = leaf;
+    if (!state.compare_exchange_strong(expected, expanding)) {
+        return false;
+    }
+    children = other.children;
+    n_children = other.n_children;
+    state.store(expanded, std::memory_order_release);
+    return true;
 }
 
 /*
-    evaluate an action
+    select the next action
+    the children are unpacked into float arrays first, each atomic is read once,
+    then all of them are scored in one pass with the parent term computed once
+    return index of the child in the arena
 */
-double Node::get_value(double c_puct, double c_virtual_loss) const {
-    unsigned n_visit = this->n_visit.load();
-    double u_sa = c_puct * p_sa * sqrt(parent->n_visit.load()) / (1 + n_visit);
-    double virtual_loss = c_virtual_loss * this->virtual_loss.load();
-    return n_visit == 0 ? u_sa : (q_sa * n_visit - virtual_loss) / n_visit + u_sa;
+uint32_t Node::select(NodeArena &arena, double c_puct, double c_virtual_loss, bool &collision) {
+    Node *first = &arena[children];
+    SelectInput in;
+    int count = n_children;
+    const float w_unit = static_cast<float>(1.0 / w_scale), loss = static_cast<float>(c_virtual_loss);
+    for (int i = 0; i < count; ++i) {
+        uint64_t stats = first[i].stats.load(std::memory_order_relaxed); // consistent snapshot of n_visit and w_sa
+        unsigned n_visit = unpack_n_visit(stats);
+        float q = unpack_w(stats) * w_unit - loss * first[i].virtual_loss.load(std::memory_order_relaxed);
+        in.p[i] = first[i].p_sa;
+        in.q[i] = n_visit == 0 ? 0.0f : q;
+        in.n[i] = static_cast<float>(n_visit);
+    }
+    int padded = (count + select_lanes - 1) / select_lanes * select_lanes;
+    for (int i = count; i < padded; ++i) {
+        in.p[i] = 0.0f;
+        in.q[i] = -FLT_MAX;
+        in.n[i] = 0.0f;
+    }
+    float c = static_cast<float>(c_puct * std::sqrt(get_n_visit()));
+#ifdef MCTS_SELECT_AVX2
+    int best = has_avx2() ? select_best_avx2(in, padded, c) : select_best_generic(in, count, c);
+#else
+    int best = select_best_generic(in, count, c);
+#endif
+    collision = first[best].virtual_loss.fetch_add(1, std::memory_order_relaxed) > 0;
+    return children + best;
 }
 
+constexpr int MCTS::max_depth;
+
 MCTS::MCTS(size_t thread_num, int n_playout, double c_puct, double c_virtual_loss) : 
     n_playout(n_playout), c_puct(c_puct), c_virtual_loss(c_virtual_loss),
-    root(new Node(), MCTS::tree_deleter), 
-    thread_pool(new ThreadPool(thread_num)) { }
+    thread_pool(new ThreadPool(thread_num)),
+    telemetry({"playouts", "expansions", "transpositions", "terminals", "collisions", "searches",
+        "unexpanded", "compactions", "pruned", "book_hits", "forced_moves", "early_stops"},
+        {"playout_us", "policy_us", "depth", "search_us", "compact_us"}) {
+    reset_tree();
+}
+
+MCTS::~MCTS() {
+    stop_pondering();
+}
+
+void MCTS::set_transposition_table_size(size_t size_mb) {
+    stop_pondering();
+    transposition_table.reset(size_mb > 0 ? new TranspositionTable(size_mb) : nullptr);
+}
+
+void MCTS::set_n_playout(int n_playout) {
+    if (n_playout < 1) {
+        throw std::invalid_argument("n_playout must be at least 1");
+    }
+    this->n_playout = n_playout;
+}
+
+void MCTS::set_node_budget(size_t max_nodes) {
+    stop_pondering();
+    node_budget = max_nodes;
+}
+
+void MCTS::reset_tree() {
+    arena.clear();
+    root = arena.allocate(1);
+    arena[root].init(-1, 1.0);
+    has_garbage = false;
+    if (transposition_table) {
+        transposition_table->clear();
+    }
+}
+
+void MCTS::prepare_tree(const Board &board) {
+    if (node_budget == 0) {
+        if (has_garbage) {
+            compact_tree(board, 0);
+        }
+    }
+    else if (arena.size() > node_budget / 4 * 3) {
+        compact_tree(board, node_budget / 2);
+    }
+}
 
-void MCTS::tree_deleter(Node *root) {
-    for (auto &child : root->children) {
-        tree_deleter(child);
+/*
+    copy the subtree of root into a new arena, most visited nodes first
+    children blocks are copied while they fit in max_nodes (0 for no limit), so the least
+    visited subtrees are pruned, their roots become leaves that keep their statistics
+    the children of root are always kept
+    children blocks shared by transpositions are copied once, and the
+    transposition table is refilled with the new indices
+    the old arena, including all discarded siblings, is freed on the background reclaimer
+    must not run concurrently with playouts
+*/
+void MCTS::compact_tree(const Board &board, size_t max_nodes) {
+    struct Item {
+        uint32_t src, dst;
+        uint64_t hash;
+        int depth;
+        unsigned n_visit;
+        bool operator<(const Item &other) const { return n_visit < other.n_visit; }
+    };
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<NodeArena> live = std::make_shared<NodeArena>();
+    auto copy = [](Node &dst, const Node &src) {
+        dst.init(src.action, src.p_sa);
+        dst.stats.store(src.stats.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    };
+    if (transposition_table) {
+        transposition_table->clear();
+    }
+    uint32_t new_root = live->allocate(1);
+    copy((*live)[new_root], arena[root]);
+    std::priority_queue<Item> queue;
+    queue.push({root, new_root, board.get_hash(), 0, arena[root].get_n_visit()});
+    std::unordered_map<uint32_t, uint32_t> blocks; // old block -> new block
+    while (!queue.empty()) {
+        Item item = queue.top();
+        queue.pop();
+        const Node &src = arena[item.src];
+        Node &dst = (*live)[item.dst];
+        if (src.get_is_leaf()) {
+            continue;
+        }
+        auto it = blocks.find(src.children);
+        if (it == blocks.end()) {
+            if (max_nodes > 0 && item.depth > 0 && live->size() + src.n_children > max_nodes) {
+                telemetry.add(stat_pruned);
+                continue;
+            }
+            uint32_t block = live->allocate(src.n_children);
+            it = blocks.emplace(src.children, block).first;
+            int player = item.depth % 2 == 0 ? board.get_cur_player() : -board.get_cur_player();
+            for (uint32_t j = 0; j < src.n_children; ++j) {
+                const Node &child = arena[src.children + j];
+                copy((*live)[block + j], child);
+                uint64_t hash = item.hash ^ Board::get_zobrist_key(board.to_bit(child.action), player)
+                    ^ Board::get_zobrist_side_key();
+                queue.push({src.children + j, block + j, hash, item.depth + 1, child.get_n_visit()});
+            }
+        }
+        dst.children = it->second;
+        dst.n_children = src.n_children;
+        dst.state.store(Node::expanded, std::memory_order_relaxed);
+        if (transposition_table) {
+            transposition_table->store(item.hash, item.dst, board.get_move_cnt() + item.depth);
+        }
     }
-    delete root;
-    root = nullptr;
+    arena.swap(*live);
+    Reclaimer::defer(std::move(live));
+    root = new_root;
+    has_garbage = false;
+    telemetry.add(stat_compactions);
+    telemetry.record(stat_compact_us, std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
 }
 
 /*
     simulation from root to leaf
     copy of board is needed
+    the path is recorded because a node may be reached from several parents
 */
 void MCTS::playout(Board board) {
-    Node *cur = root.get();
-    while (!cur->get_is_leaf()) {
-        cur = cur->select(c_puct, c_virtual_loss);
-        board.exec_move(cur->action);
+    auto start = std::chrono::steady_clock::now();
+    uint32_t path[max_depth];
+    int depth = 0;
+    uint32_t cur = root;
+    path[depth++] = cur;
+    while (true) {
+        while (!arena[cur].get_is_leaf()) {
+            bool collision;
+            cur = arena[cur].select(arena, c_puct, c_virtual_loss, collision);
+            if (collision) {
+                telemetry.add(stat_collisions);
+            }
+            board.exec_move(arena[cur].action);
+            path[depth++] = cur;
+        }
+        if (board.get_result().first || transposition_table == nullptr) {
+            break;
+        }
+        // the same position may already be expanded through another move order
+        // if so, share its children and back up its mean value instead of evaluating again
+        uint32_t other = transposition_table->probe(board.get_hash());
+        if (other == TranspositionTable::not_found || other == cur 
+            || arena[other].get_is_leaf() || !arena[cur].link(arena[other])) {
+            break;
+        }
+        uint64_t stats = arena[other].stats.load(std::memory_order_relaxed);
+        unsigned n_visit = Node::unpack_n_visit(stats);
+        if (n_visit > 0) {
+            backup(path, depth, Node::unpack_w(stats) / Node::w_scale / n_visit);
+            telemetry.add(stat_transpositions);
+            record_playout(start, depth);
+            return;
+        }
     }
     auto res = board.get_result();
     if (!res.first) { // if not ended
         auto actions = board.get_moves();
+        auto policy_start = std::chrono::steady_clock::now();
         auto pi = policy(board);
-        cur->expand(pi.first, actions);
+        auto policy_end = std::chrono::steady_clock::now();
+        telemetry.record(stat_policy_us, std::chrono::duration_cast<std::chrono::microseconds>(policy_end - policy_start).count());
+        trace.add("policy", policy_start, policy_end);
+        if (node_budget > 0 && cur != root && arena.size() + actions.size() > node_budget) {
+            telemetry.add(stat_unexpanded); // the tree is full, only the value is used
+        }
+        else if (arena[cur].expand(arena, pi.first, actions)) {
+            telemetry.add(stat_expansions);
+            if (transposition_table) {
+                transposition_table->store(board.get_hash(), cur, board.get_move_cnt());
+            }
+        }
         // you may feel confused about the negative sign
         // recall that from parent's perspective, this cur node is represent for the oppoent
-        cur->backup(-pi.second);
+        backup(path, depth, -pi.second);
     }
     else {
         double value = res.second == 0 ? 0 : res.second == board.get_cur_player() ? 1 : -1;
-        cur->backup(-value);
+        backup(path, depth, -value);
+        telemetry.add(stat_terminals);
+    }
+    record_playout(start, depth);
+}
+
+void MCTS::record_playout(std::chrono::steady_clock::time_point start, int depth) {
+    auto end = std::chrono::steady_clock::now();
+    telemetry.add(stat_playouts);
+    telemetry.record(stat_playout_us, std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    telemetry.record(stat_depth, depth - 1);
+    trace.add("playout", start, end);
+}
+
+/*
+    propagate value from leaf to root along the path
+    a single wait-free fetch_add per level updates n_visit and w_sa
+*/
+void MCTS::backup(const uint32_t *path, int depth, double value) {
+    uint64_t deltas[2] = {Node::pack_delta(value), Node::pack_delta(-value)}; // -value for the opposite player
+    for (int i = depth - 1; i >= 0; --i) {
+        Node &node = arena[path[i]];
+        node.stats.fetch_add(deltas[(depth - 1 - i) & 1], std::memory_order_relaxed);
+        if (i > 0) { // root is never selected, so it holds no virtual loss
+            node.virtual_loss.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+/*
+    the most visited child of root, ties go to the higher prior
+*/
+int MCTS::get_most_visited_action(const Board &board) {
+    const Node &cur = arena[root];
+    if (cur.get_is_leaf() || cur.n_children == 0) {
+        auto moves = board.get_moves();
+        return moves.empty() ? -1 : moves.front();
+    }
+    const Node *first = &arena[cur.children];
+    int best = 0;
+    for (int i = 1; i < cur.n_children; ++i) {
+        unsigned n_visit = first[i].get_n_visit(), best_n_visit = first[best].get_n_visit();
+        if (n_visit > best_n_visit || (n_visit == best_n_visit && first[i].p_sa > first[best].p_sa)) {
+            best = i;
+        }
     }
+    return first[best].action;
+}
+
+int MCTS::get_forced_action(const Board &board) const {
+    int n = board.get_n(), n_in_row = board.get_n_in_row(), cur_player = board.get_cur_player();
+    BitBoard empty = board.get_empty();
+    int bit = Rollout::get_winning_cells(board.get_stones(cur_player), empty, n, n_in_row).lowest();
+    if (bit == -1) {
+        // with two winning cells of the opponent the game is lost whatever is played
+        bit = Rollout::get_winning_cells(board.get_stones(-cur_player), empty, n, n_in_row).lowest();
+    }
+    return bit == -1 ? -1 : board.to_pos(bit);
+}
+
+bool MCTS::get_is_decided(unsigned n_visit) const {
+    const Node &cur = arena[root];
+    if (cur.get_is_leaf()) {
+        return false;
+    }
+    unsigned n_done = cur.get_n_visit();
+    unsigned remaining = n_visit > n_done ? n_visit - n_done : 0;
+    const Node *first = &arena[cur.children];
+    unsigned best = 0, second = 0;
+    for (int i = 0; i < cur.n_children; ++i) {
+        unsigned n = first[i].get_n_visit();
+        if (n > best) {
+            second = best;
+            best = n;
+        }
+        else if (n > second) {
+            second = n;
+        }
+    }
+    return best > second + remaining;
 }
 
 /*
     get action, take action greedily 
 */
 int MCTS::get_action(const Board &board) {
-    startup(board);
-    return (*max_element(root->children.cbegin(), root->children.cend(), 
-        [](const Node *a, const Node *b) {
-            return a->n_visit < b->n_visit;
-        }))->action;
+    stop_pondering();
+    if (board.get_moves().empty()) {
+        throw std::invalid_argument("the board has no legal move");
+    }
+    std::vector<double> book_probs;
+    if (opening_book && opening_book->lookup(board, book_probs)) {
+        telemetry.add(stat_book_hits);
+        return static_cast<int>(std::max_element(book_probs.cbegin(), book_probs.cend()) - book_probs.cbegin());
+    }
+    int forced = early_stop ? get_forced_action(board) : -1;
+    if (forced != -1) {
+        telemetry.add(stat_forced_moves);
+        return forced;
+    }
+    startup(board, early_stop);
+    return get_most_visited_action(board);
 }
 
 /*
     helper function
     start up all simulations
 */
-void MCTS::startup(const Board &board) {
-    int n_need = n_playout - root->n_visit; // reuse the previous result
-    std::vector<std::future<void>> futures;
-    futures.reserve(n_need);
-    // commit all simulation tasks
-    for (int i = 0; i < n_need; ++i) {
-        auto future = thread_pool->commit(std::bind(&MCTS::playout, this, board));
-        futures.emplace_back(std::move(future));
+void MCTS::startup(const Board &board, bool stop_when_decided) {
+    prepare_tree(board);
+    // the time budget is for playouts only
+    auto start = std::chrono::steady_clock::now();
+    // the root children are scanned every 16 playouts, not before each one
+    std::atomic<unsigned> n_calls{0};
+    std::atomic<bool> decided{false};
+    unsigned n_visit = n_playout;
+    auto keep_going = [&]() {
+        if (!stop_when_decided || (n_calls.fetch_add(1, std::memory_order_relaxed) & 15) != 15) {
+            return true;
+        }
+        if (get_is_decided(n_visit)) {
+            decided.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    };
+    // visits of root from previous searches are reused
+    if (time_budget_ms > 0) {
+        auto deadline = start + std::chrono::milliseconds(time_budget_ms);
+        search(board, n_visit, &deadline, keep_going);
+    }
+    else {
+        search(board, n_visit, nullptr, keep_going);
+    }
+    auto end = std::chrono::steady_clock::now();
+    telemetry.add(stat_searches);
+    if (decided.load()) {
+        telemetry.add(stat_early_stops);
+    }
+    telemetry.record(stat_search_us, std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    if (trace.get_is_enabled()) {
+        trace.add("search", start, end);
+        trace.stop();
+        if (!trace.write(trace_path)) {
+            std::cerr << "Warning: cannot write trace to " << trace_path << std::endl;
+        }
+    }
+}
+
+void MCTS::trace_next_search(std::string path) {
+    stop_pondering();
+    trace_path = path;
+    trace.start();
+}
+
+std::map<std::string, double> MCTS::get_stats() const {
+    auto res = telemetry.snapshot();
+    res["nodes"] = static_cast<double>(arena.size());
+    res["node_bytes"] = static_cast<double>(arena.size() * sizeof(Node));
+    double search_s = res["search_us.mean"] * res["search_us.count"] / 1e6;
+    res["playouts_per_second"] = search_s > 0 ? res["playouts"] / search_s : 0.0;
+    return res;
+}
+
+/*
+    helper function
+    all simulations run as one bulk job, no task is allocated per playout
+*/
+template <class F>
+void MCTS::search(const Board &board, unsigned n_visit, const std::chrono::steady_clock::time_point *deadline, F &&keep_going) {
+    unsigned n_done = arena[root].get_n_visit();
+    if (n_done >= n_visit) {
+        return;
+    }
+    thread_pool->parallel_for(n_visit - n_done, [&](size_t) {
+        if (!keep_going()) {
+            return false;
+        }
+        // the deadline counts only once root is expanded and a playout finished, so there is a move to choose
+        if (deadline != nullptr && !arena[root].get_is_leaf() && arena[root].get_n_visit() > n_done
+            && std::chrono::steady_clock::now() >= *deadline) {
+            return false;
+        }
+        playout(board);
+        return true;
+    });
+}
+
+void MCTS::start_pondering(const Board &board, int max_playouts) {
+    stop_pondering();
+    if (board.get_result().first) {
+        return;
     }
-    // wait for all tasks finished
-    for (int i = 0; i < futures.size(); ++i) {
-        futures[i].wait();
+    prepare_tree(board);
+    unsigned n_visit = max_playouts > 0 ? max_playouts : n_playout;
+    pondering.store(true);
+    ponder_thread = std::thread([this, board, n_visit]() {
+        search(board, n_visit, nullptr, [this]() { return pondering.load(std::memory_order_relaxed); });
+    });
+}
+
+void MCTS::stop_pondering() {
+    pondering.store(false);
+    if (ponder_thread.joinable()) {
+        ponder_thread.join();
     }
 }
 
 /*
-    naive policy, using rollout
+    naive policy, uniform priors and a heuristic rollout
     it is O(board_size), efficient enough
     return (action_priors, value)
 */
@@ -142,35 +592,29 @@ std::pair<std::vector<double>, double> MCTS::policy(Board &board) {
     auto actions = board.get_moves();
     // each action is taken in equal probability
     std::vector<double> action_priors(board.get_board_size(), 1.0 / actions.size());
-    int player = board.get_cur_player();
-    // take action randomly
-    std::random_shuffle(actions.begin(), actions.end());
-    std::pair<bool, int> res;
-    for (const auto &act : actions) {
-        board.exec_move(act);
-        res = board.get_result();
-        if (res.first) break;
-    }
-    double value = res.second == 0 ? 0 : res.second == player ? 1 : -1;
-    return std::make_pair(action_priors, value);
+    return std::make_pair(action_priors, Rollout::simulate(board));
 }
 
 /*
     update with the oppoent's move 
     reuse the tree instead of destroying it directly 
+    the rest of the tree is released in O(1), its memory is reclaimed by a later compaction
 */
 void MCTS::update_with_move(int last_action) {
-    for (auto it = root->children.begin(); it != root->children.end(); ++it) {
-        if ((*it)->action == last_action) {
-            Node *new_root = *it;
-            root->children.erase(it);
-            new_root->parent = nullptr;
-            root.reset(new_root);
-            return;
+    stop_pondering();
+    const Node &cur = arena[root];
+    if (!cur.get_is_leaf()) {
+        for (uint32_t i = 0; i < cur.n_children; ++i) {
+            uint32_t child = cur.children + i;
+            if (arena[child].action == last_action) {
+                root = child;
+                has_garbage = true;
+                return;
+            }
         }
     }
     // if there is not such action, reset the tree
-    root.reset(new Node());
+    reset_tree();
 }
 
 AlphaZero::AlphaZero(NeuralNetwork *neural_network, size_t thread_num, int n_playout, double c_puct, double c_virtual_loss) : 
@@ -180,10 +624,11 @@ AlphaZero::AlphaZero(NeuralNetwork *neural_network, size_t thread_num, int n_pla
     AlphaZero's policy, using neural network
 */
 std::pair<std::vector<double>, double> AlphaZero::policy(Board &board) {
-    auto future = neural_network->commit(board);
-    auto result = future.get();
-    double value = result[1][0];
-    auto action_priors = std::move(result[0]);
+    // read the policy row in place from the batch output
+    auto result = neural_network->evaluate(board);
+    const float *prob = result.get_prob();
+    double value = result.get_value();
+    std::vector<double> action_priors(prob, prob + board.get_board_size());
     double sum = std::accumulate(action_priors.cbegin(), action_priors.cend(), 0.0);
     if (sum < FLT_EPSILON) {
         std::cerr << "Warning: no valid move." << std::endl;
@@ -202,21 +647,63 @@ std::pair<std::vector<double>, double> AlphaZero::policy(Board &board) {
     get action probs
 */
 std::vector<double> AlphaZero::get_action_probs(const Board &board, double temp) {
-    startup(board);
-    std::vector<double> action_probs(board.get_board_size(), 0.0);
+    stop_pondering();
+    if (board.get_moves().empty()) {
+        throw std::invalid_argument("the board has no legal move");
+    }
+    std::vector<double> action_probs;
+    if (opening_book && opening_book->lookup(board, action_probs)) { // root visit shares of a deeper search
+        telemetry.add(stat_book_hits);
+        if (temp < FLT_EPSILON) {
+            int best = static_cast<int>(std::max_element(action_probs.cbegin(), action_probs.cend()) - action_probs.cbegin());
+            std::fill(action_probs.begin(), action_probs.end(), 0.0);
+            action_probs[best] = 1.0;
+        }
+        else {
+            double sum = 0;
+            for (double &x : action_probs) {
+                x = std::pow(x, 1.0 / temp);
+                sum += x;
+            }
+            std::for_each(action_probs.begin(), action_probs.end(),
+                [sum](double &x) { x /= sum; });
+        }
+        return action_probs;
+    }
+    // a visit distribution is searched in full, a one-hot forced move would become its policy target
+    int forced = early_stop && temp < FLT_EPSILON ? get_forced_action(board) : -1;
+    if (forced != -1) {
+        telemetry.add(stat_forced_moves);
+        action_probs.assign(board.get_board_size(), 0.0);
+        action_probs[forced] = 1.0;
+        return action_probs;
+    }
+    // only the most visited child matters to a greedy move
+    startup(board, early_stop && temp < FLT_EPSILON);
+    action_probs.assign(board.get_board_size(), 0.0);
     if (temp < FLT_EPSILON) { // greedy
-        int action = (*max_element(root->children.cbegin(), root->children.cend(), 
-            [](const Node *a, const Node *b) {
-                return a->n_visit < b->n_visit;
-            }))->action;
-        action_probs[action] = 1.0;
+        action_probs[get_most_visited_action(board)] = 1.0;
+    }
+    else if (arena[root].get_is_leaf()) { // nothing was searched, e.g. the time budget ran out
+        auto actions = board.get_moves();
+        for (int action : actions) {
+            action_probs[action] = 1.0 / actions.size();
+        }
     }
     else {
         double sum = 0;
         // p:=p^(1/temp)
-        for (const auto &child : root->children) {
-            action_probs[child->action] = std::pow(child->n_visit.load(), 1.0 / temp);
-            sum += action_probs[child->action];
+        const Node &cur = arena[root];
+        const Node *first = &arena[cur.children];
+        for (int i = 0; i < cur.n_children; ++i) {
+            action_probs[first[i].action] = std::pow(first[i].get_n_visit(), 1.0 / temp);
+            sum += action_probs[first[i].action];
+        }
+        if (sum == 0) { // only root was visited, use the priors
+            for (int i = 0; i < cur.n_children; ++i) {
+                action_probs[first[i].action] = first[i].p_sa;
+                sum += first[i].p_sa;
+            }
         }
         // normalization
         std::for_each(action_probs.begin(), action_probs.end(), 
@@ -1,69 +1,177 @@
 #pragma once
 #include "board.h"
+#include "arena.h"
+#include "transposition_table.h"
 #include "thread_pool.h"
 #include "neural_network.h"
+#include "telemetry.h"
+#include "opening_book.h"
 #include <vector>
+#include <string>
+#include <map>
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 
+class Node;
+using NodeArena = Arena<Node>;
+
+/*
+    nodes live in a per-tree arena and refer to each other by index
+    all children of a node are allocated as one contiguous block
+    a node holds the statistics of the edge leading to it, while its children block may be
+    shared with other nodes of the same position, which turns the tree into a DAG
+*/
 class Node {
 public:
     friend class MCTS;
     friend class AlphaZero;
 
-    Node(Node *parent, double p_sa, int action);
+    void init(int action, double p_sa);
 
-    Node* select(double c_puct, double c_virtual_loss);
-    void expand(const std::vector<double> &action_priors, const std::vector<int> &actions);
-    void backup(double value);
-    double get_value(double c_puct, double c_virtual_loss) const;
+    // collision is set if another thread is already in the selected child
+    uint32_t select(NodeArena &arena, double c_puct, double c_virtual_loss, bool &collision);
+    bool expand(NodeArena &arena, const std::vector<double> &action_priors, const std::vector<int> &actions);
+    bool link(const Node &other);
 
-    bool get_is_leaf() const { return is_leaf.load(); }
+    bool get_is_leaf() const { return state.load(std::memory_order_acquire) != expanded; }
+    unsigned get_n_visit() const { return unpack_n_visit(stats.load(std::memory_order_relaxed)); }
 private:
-    Node *parent;
-    std::vector<Node*> children;         // children list, dynamic size to reduce memory use
-    int action;                          // action: parent -> this
-    double p_sa = 1;
-    double q_sa = 0;
-    std::atomic<unsigned> n_visit{0};
-    std::atomic<int> virtual_loss{0};    // used in tree parallelization
-    std::atomic<bool> is_parent{false};
-    std::atomic<bool> is_leaf{true};
-    std::mutex mutex_val;                // simple mutex to resolve w/r conflict
+    enum : uint8_t { leaf, expanding, expanded };
+
+    /*
+        n_visit and the value sum w_sa share one 64-bit word, so one fetch_add updates both
+        and one load reads a consistent snapshot
+        high 26 bits: n_visit, low 38 bits: w_sa as signed fixed-point with 11 fractional bits
+    */
+    static constexpr int w_bits = 38;
+    static constexpr double w_scale = 2048.0;
+    static uint64_t pack_delta(double value);
+    static int64_t unpack_w(uint64_t stats) { return int64_t(stats << (64 - w_bits)) >> (64 - w_bits); }
+    static unsigned unpack_n_visit(uint64_t stats) { return unsigned((stats - uint64_t(unpack_w(stats))) >> w_bits); }
+
+    uint32_t children;                   // index of the first child
+    uint16_t n_children;
+    int16_t action;                      // action: parent -> this
+    float p_sa;
+    std::atomic<int> virtual_loss;       // used in tree parallelization
+    std::atomic<uint8_t> state;          // leaf -> expanding -> expanded
+    std::atomic<uint64_t> stats;         // packed (n_visit, w_sa)
 };
 
 class MCTS {
 public:
     MCTS(size_t thread_num, int n_playout, double c_puct, double c_virtual_loss);
+    virtual ~MCTS();
 
+    // throws std::invalid_argument if the board has no legal move
     int get_action(const Board &board);
     void update_with_move(int last_action);
+    // share subtrees of transposed positions, 0 disables, must not be called during search
+    void set_transposition_table_size(size_t size_mb);
+    // stop each search after this many milliseconds even if n_playout is not reached, 0 for no limit
+    void set_time_budget(unsigned time_budget_ms) { this->time_budget_ms = time_budget_ms; }
+    // answer positions in the book from it without searching, nullptr disables, the book must outlive the tree
+    void set_opening_book(const OpeningBook *opening_book) { this->opening_book = opening_book; }
+    /*
+        play forced moves (a win, the only block, or any block of a lost position) without searching,
+        and end a search once its most visited root child cannot be overtaken by the remaining playouts
+        both apply to greedy moves only, searches for a visit distribution, get_action_probs
+        with temp > 0, still run in full
+        on by default
+    */
+    void set_early_stop(bool early_stop) { this->early_stop = early_stop; }
+    // root visits per search from the next search on, at least 1
+    void set_n_playout(int n_playout);
+    /*
+        cap the tree at about max_nodes nodes, 0 for no limit
+        discarded subtrees are then kept until a search starts with the tree over 3/4 of the budget,
+        which compacts it and prunes the least visited subtrees down to half of the budget
+        a full tree still evaluates leaves, but does not expand them, except for the root
+    */
+    void set_node_budget(size_t max_nodes);
+
+    /*
+        keep searching the position in the background, e.g. while the opponent is thinking
+        pondering runs until max_playouts root visits (n_playout if 0) or until it is stopped,
+        any other call on this tree stops it first, so update_with_move keeps the pondered subtree
+    */
+    void start_pondering(const Board &board, int max_playouts = 0);
+    void stop_pondering();
+    bool get_is_pondering() const { return pondering.load(); }
+
+    /*
+        statistics since the last reset: counters, histograms as in Telemetry::snapshot,
+        and the current tree size
+    */
+    std::map<std::string, double> get_stats() const;
+    void reset_stats() { telemetry.reset(); }
+    // record the next search as a chrome trace event file at path
+    void trace_next_search(std::string path);
 
     // virtual function, policy can be varied
     virtual std::pair<std::vector<double>, double> policy(Board &board);
 protected:
-    // to release memory
-    static void tree_deleter(Node *root);
+    // longest root to leaf path
+    static constexpr int max_depth = BitBoard::max_n * BitBoard::max_n + 1;
+
+    void reset_tree();
+    // compact the tree before a search if it holds garbage or is close to the node budget
+    void prepare_tree(const Board &board);
+    // copy the live subtree into a fresh arena, dropping discarded siblings and keeping at most max_nodes nodes
+    void compact_tree(const Board &board, size_t max_nodes);
 
-    void startup(const Board &board);
+    // run the search of a move, stopping once the most visited root child is settled if stop_when_decided is set
+    void startup(const Board &board, bool stop_when_decided);
+    // forced move of the player to move as in set_early_stop, -1 if there is none
+    int get_forced_action(const Board &board) const;
+    // whether the most visited root child stays ahead of the others within n_visit root visits
+    bool get_is_decided(unsigned n_visit) const;
+    // run playouts until root has n_visit visits, the deadline passes or keep_going returns false
+    template <class F>
+    void search(const Board &board, unsigned n_visit, const std::chrono::steady_clock::time_point *deadline, F &&keep_going);
     void playout(Board board);
+    void record_playout(std::chrono::steady_clock::time_point start, int depth);
+    void backup(const uint32_t *path, int depth, double value);
+    // the first legal move if root is not expanded yet, -1 if there is none
+    int get_most_visited_action(const Board &board);
 
-    std::unique_ptr<Node, decltype(MCTS::tree_deleter)*> root;
+    NodeArena arena;
+    uint32_t root;
+    bool has_garbage = false;  // nodes outside the root's subtree are still in the arena
+    std::unique_ptr<TranspositionTable> transposition_table; // nullptr if disabled
     std::unique_ptr<ThreadPool> thread_pool;
     int n_playout;
     double c_puct;
     double c_virtual_loss;  // virtual loss is used in tree parallelization
+    unsigned time_budget_ms = 0;
+    size_t node_budget = 0;
+    const OpeningBook *opening_book = nullptr;
+    bool early_stop = true;
+    std::atomic<bool> pondering{false};
+    std::thread ponder_thread;
+
+    enum { stat_playouts, stat_expansions, stat_transpositions, stat_terminals, stat_collisions, stat_searches,
+        stat_unexpanded, stat_compactions, stat_pruned, stat_book_hits, stat_forced_moves, stat_early_stops };
+    enum { stat_playout_us, stat_policy_us, stat_depth, stat_search_us, stat_compact_us };
+    Telemetry telemetry;
+    TraceRecorder trace;
+    std::string trace_path;
 };
 
 class AlphaZero : public MCTS {
 public:
     AlphaZero(NeuralNetwork *neural_network, size_t thread_num, int n_playout, double c_puct, double c_virtual_loss);
+    // pondering calls policy, so it must stop before this object is gone
+    ~AlphaZero() override { stop_pondering(); }
 
     // policy of AlphaZero
     std::pair<std::vector<double>, double> policy(Board &board) override;
 
+    // throws std::invalid_argument if the board has no legal move
     std::vector<double> get_action_probs(const Board &board, double temp = 0.0);
 private:
     NeuralNetwork *neural_network;
-};
\ No newline at end of file
+};
@@ -0,0 +1,528 @@
+#include "native_network.h"
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NATIVE_NETWORK_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr float bn_eps = 1e-5f;  // pytorch default of BatchNorm2d
+
+int round_up(int x, int m) {
+    return (x + m - 1) / m * m;
+}
+
+// columns and depth of the blocks of b that the kernels stream, a block stays in l2
+constexpr int block_cols = 128;
+constexpr int block_k = 256;
+
+/*
+    one panel of up to 4 rows times all columns, 16 columns at a time
+    a [k, 4], bias [4], b [k, cols], out [rows, ldc]
+    with accumulate, the products are added to out instead of to the bias
+*/
+void gemm_panel(const float *a, const float *bias, int k, const float *b, int cols, float *out, int ldc, int rows,
+    bool accumulate) {
+    for (int j = 0; j < cols; j += 16) {
+        float acc[4][16];
+        for (int r = 0; r < 4; ++r) {
+            for (int c = 0; c < 16; ++c) {
+                acc[r][c] = !accumulate ? bias[r] : r < rows ? out[r * ldc + j + c] : 0.0f;
+            }
+        }
+        for (int i = 0; i < k; ++i) {
+            const float *ai = a + i * 4;
+            const float *bi = b + i * cols + j;
+            for (int r = 0; r < 4; ++r) {
+                for (int c = 0; c < 16; ++c) {
+                    acc[r][c] += ai[r] * bi[c];
+                }
+            }
+        }
+        for (int r = 0; r < rows; ++r) {
+            std::copy(acc[r], acc[r] + 16, out + r * ldc + j);
+        }
+    }
+}
+
+// a [k / 2, 4, 2], b [k / 2, cols, 2], out = acc * scale * col_scale + bias, or + out with accumulate
+void gemm_panel_q(const int16_t *a, const float *scale, const float *col_scale, const float *bias, int k2,
+    const int16_t *b, int cols, float *out, int ldc, int rows, bool accumulate) {
+    for (int j = 0; j < cols; j += 16) {
+        int32_t acc[4][16] = {{0}};
+        for (int i = 0; i < k2; ++i) {
+            const int16_t *ai = a + i * 8;
+            const int16_t *bi = b + (i * cols + j) * 2;
+            for (int r = 0; r < 4; ++r) {
+                for (int c = 0; c < 16; ++c) {
+                    acc[r][c] += ai[r * 2] * bi[c * 2] + ai[r * 2 + 1] * bi[c * 2 + 1];
+                }
+            }
+        }
+        for (int r = 0; r < rows; ++r) {
+            for (int c = 0; c < 16; ++c) {
+                float base = accumulate ? out[r * ldc + j + c] : bias[r];
+                out[r * ldc + j + c] = acc[r][c] * scale[r] * col_scale[j + c] + base;
+            }
+        }
+    }
+}
+
+#ifdef NATIVE_NETWORK_AVX2
+bool has_avx2() {
+    static const bool res = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return res;
+}
+
+// the start of 8 accumulated columns of row r, see gemm_panel
+__attribute__((target("avx2,fma")))
+inline __m256 load_acc(const float *bias, const float *out, int r, int rows, bool accumulate) {
+    return !accumulate ? _mm256_set1_ps(bias[r]) : r < rows ? _mm256_loadu_ps(out) : _mm256_setzero_ps();
+}
+
+// 4 x 16 tile in 8 accumulators, one broadcast and two fma per row and k
+__attribute__((target("avx2,fma")))
+void gemm_panel_avx2(const float *a, const float *bias, int k, const float *b, int cols, float *out, int ldc, int rows,
+    bool accumulate) {
+    for (int j = 0; j < cols; j += 16) {
+        __m256 c00 = load_acc(bias, out + j, 0, rows, accumulate), c01 = load_acc(bias, out + j + 8, 0, rows, accumulate);
+        __m256 c10 = load_acc(bias, out + ldc + j, 1, rows, accumulate), c11 = load_acc(bias, out + ldc + j + 8, 1, rows, accumulate);
+        __m256 c20 = load_acc(bias, out + 2 * ldc + j, 2, rows, accumulate);
+        __m256 c21 = load_acc(bias, out + 2 * ldc + j + 8, 2, rows, accumulate);
+        __m256 c30 = load_acc(bias, out + 3 * ldc + j, 3, rows, accumulate);
+        __m256 c31 = load_acc(bias, out + 3 * ldc + j + 8, 3, rows, accumulate);
+        for (int i = 0; i < k; ++i) {
+            const float *ai = a + i * 4;
+            const float *bi = b + i * cols + j;
+            __m256 b0 = _mm256_loadu_ps(bi), b1 = _mm256_loadu_ps(bi + 8);
+            __m256 x = _mm256_set1_ps(ai[0]);
+            c00 = _mm256_fmadd_ps(x, b0, c00);
+            c01 = _mm256_fmadd_ps(x, b1, c01);
+            x = _mm256_set1_ps(ai[1]);
+            c10 = _mm256_fmadd_ps(x, b0, c10);
+            c11 = _mm256_fmadd_ps(x, b1, c11);
+            x = _mm256_set1_ps(ai[2]);
+            c20 = _mm256_fmadd_ps(x, b0, c20);
+            c21 = _mm256_fmadd_ps(x, b1, c21);
+            x = _mm256_set1_ps(ai[3]);
+            c30 = _mm256_fmadd_ps(x, b0, c30);
+            c31 = _mm256_fmadd_ps(x, b1, c31);
+        }
+        __m256 res[8] = {c00, c01, c10, c11, c20, c21, c30, c31};
+        for (int r = 0; r < rows; ++r) {
+            _mm256_storeu_ps(out + r * ldc + j, res[r * 2]);
+            _mm256_storeu_ps(out + r * ldc + j + 8, res[r * 2 + 1]);
+        }
+    }
+}
+
+// pairs of int16 are multiplied and summed into int32 lanes, 16 products per instruction
+__attribute__((target("avx2,fma")))
+void gemm_panel_q_avx2(const int16_t *a, const float *scale, const float *col_scale, const float *bias, int k2,
+    const int16_t *b, int cols, float *out, int ldc, int rows, bool accumulate) {
+    for (int j = 0; j < cols; j += 16) {
+        __m256i acc[8];
+        for (int t = 0; t < 8; ++t) {
+            acc[t] = _mm256_setzero_si256();
+        }
+        for (int i = 0; i < k2; ++i) {
+            const int16_t *ai = a + i * 8;
+            const int16_t *bi = b + (i * cols + j) * 2;
+            __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bi));
+            __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bi + 16));
+            for (int r = 0; r < 4; ++r) {
+                int32_t pair;
+                std::memcpy(&pair, ai + r * 2, sizeof(pair));
+                __m256i x = _mm256_set1_epi32(pair);
+                acc[r * 2] = _mm256_add_epi32(acc[r * 2], _mm256_madd_epi16(b0, x));
+                acc[r * 2 + 1] = _mm256_add_epi32(acc[r * 2 + 1], _mm256_madd_epi16(b1, x));
+            }
+        }
+        __m256 cs0 = _mm256_loadu_ps(col_scale + j), cs1 = _mm256_loadu_ps(col_scale + j + 8);
+        for (int r = 0; r < rows; ++r) {
+            __m256 s = _mm256_set1_ps(scale[r]);
+            float *dst = out + r * ldc + j;
+            __m256 o0 = load_acc(bias, dst, r, rows, accumulate), o1 = load_acc(bias, dst + 8, r, rows, accumulate);
+            _mm256_storeu_ps(dst, _mm256_fmadd_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc[r * 2]), cs0), s, o0));
+            _mm256_storeu_ps(dst + 8, _mm256_fmadd_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc[r * 2 + 1]), cs1), s, o1));
+        }
+    }
+}
+#endif
+
+void relu(float *x, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        x[i] = std::max(x[i], 0.0f);
+    }
+}
+
+}
+
+NativeNetwork::NativeNetwork(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("cannot open weights " + path);
+    }
+    auto read_u32 = [&]() {
+        uint32_t x = 0;
+        in.read(reinterpret_cast<char*>(&x), sizeof(x));
+        return x;
+    };
+    char magic[8];
+    in.read(magic, sizeof(magic));
+    if (!in || std::memcmp(magic, "AZWEIGHT", sizeof(magic)) != 0 || read_u32() != 1) {
+        throw std::runtime_error(path + " is not a weights file of a supported version");
+    }
+    uint32_t n_tensors = read_u32();
+    for (uint32_t t = 0; t < n_tensors && in; ++t) {
+        std::string name(read_u32(), '\0');
+        in.read(&name[0], name.size());
+        Tensor tensor;
+        tensor.shape.resize(read_u32());
+        size_t size = 1;
+        for (auto &dim : tensor.shape) {
+            dim = read_u32();
+            size *= dim;
+        }
+        if (!in || size > (1u << 28)) {
+            throw std::runtime_error("weights file " + path + " is corrupt");
+        }
+        tensor.data.resize(size);
+        in.read(reinterpret_cast<char*>(tensor.data.data()), size * sizeof(float));
+        tensors[name] = std::move(tensor);
+    }
+    if (!in) {
+        throw std::runtime_error("weights file " + path + " is truncated");
+    }
+
+    for (int i = 0; tensors.count("res_layers." + std::to_string(i) + ".conv1.weight"); ++i) {
+        std::string prefix = "res_layers." + std::to_string(i) + ".";
+        Block block;
+        block.conv1 = fold(prefix + "conv1", prefix + "bn1", 3);
+        block.conv2 = fold(prefix + "conv2", prefix + "bn2", 3);
+        block.has_downsample = tensors.count(prefix + "downsample_conv.weight") > 0;
+        if (block.has_downsample) {
+            block.downsample = fold(prefix + "downsample_conv", prefix + "downsample_bn", 3);
+        }
+        int in_channels = blocks.empty() ? 4 : blocks.back().conv2.m;
+        if (block.conv1.k != in_channels * 9 || block.conv2.k != block.conv1.m * 9
+            || (!block.has_downsample && block.conv2.m != in_channels)) {
+            throw std::runtime_error("residual block " + std::to_string(i) + " of " + path + " has inconsistent shapes");
+        }
+        blocks.push_back(std::move(block));
+    }
+    if (blocks.empty()) {
+        throw std::runtime_error(path + " has no residual blocks");
+    }
+    n_channels = blocks.back().conv2.m;
+    p_conv = fold("p_conv", "p_bn", 1);
+    v_conv = fold("v_conv", "v_bn", 1);
+    p_fc = linear("p_fc");
+    v_fc1 = linear("v_fc1");
+    v_fc2 = linear("v_fc2");
+    n_actions = p_fc.m;
+    n = static_cast<int>(std::lround(std::sqrt(p_fc.k / std::max(p_conv.m, 1))));
+    if (p_conv.k != n_channels || v_conv.k != n_channels || n * n != n_actions || p_fc.k != p_conv.m * n * n
+        || v_fc1.k != v_conv.m * n * n || v_fc2.k != v_fc1.m || v_fc2.m != 1) {
+        throw std::runtime_error("heads of " + path + " have inconsistent shapes");
+    }
+    tensors.clear();
+
+    block.resize(static_cast<size_t>(block_k) * block_cols);
+    block_q.resize(static_cast<size_t>(block_k) * block_cols);
+}
+
+const NativeNetwork::Tensor &NativeNetwork::get(const std::string &name) const {
+    auto it = tensors.find(name);
+    if (it == tensors.end()) {
+        throw std::runtime_error("weights file has no tensor " + name);
+    }
+    return it->second;
+}
+
+NativeNetwork::Layer NativeNetwork::make_layer(const std::vector<float> &weight, const std::vector<float> &bias,
+    int m, int k, int kernel) {
+    Layer layer;
+    layer.m = m;
+    layer.k = k;
+    layer.kernel = kernel;
+    layer.weight = weight;
+    int panels = (m + 3) / 4;
+    layer.packed.assign(panels * k * 4, 0.0f);
+    layer.bias.assign(panels * 4, 0.0f);
+    for (int row = 0; row < m; ++row) {
+        for (int i = 0; i < k; ++i) {
+            layer.packed[((row / 4) * k + i) * 4 + row % 4] = weight[row * k + i];
+        }
+        layer.bias[row] = bias[row];
+    }
+    return layer;
+}
+
+/*
+    bn(conv(x)) = scale * conv(x) + shift with scale = gamma / sqrt(var + eps) and
+    shift = beta - mean * scale, so scale goes into the weights and shift becomes the bias
+*/
+NativeNetwork::Layer NativeNetwork::fold(const std::string &conv, const std::string &bn, int kernel) const {
+    const Tensor &w = get(conv + ".weight");
+    const Tensor &gamma = get(bn + ".weight"), &beta = get(bn + ".bias");
+    const Tensor &mean = get(bn + ".running_mean"), &var = get(bn + ".running_var");
+    int m = w.shape.size() == 4 ? w.shape[0] : 0;
+    if (m == 0 || w.shape[2] != static_cast<uint32_t>(kernel) || w.shape[3] != static_cast<uint32_t>(kernel)
+        || gamma.data.size() != static_cast<size_t>(m) || beta.data.size() != static_cast<size_t>(m)
+        || mean.data.size() != static_cast<size_t>(m) || var.data.size() != static_cast<size_t>(m)) {
+        throw std::runtime_error("unexpected shape of " + conv + " or " + bn);
+    }
+    int k = static_cast<int>(w.data.size()) / m;
+    std::vector<float> weight(w.data), bias(m);
+    for (int row = 0; row < m; ++row) {
+        float scale = gamma.data[row] / std::sqrt(var.data[row] + bn_eps);
+        for (int i = 0; i < k; ++i) {
+            weight[row * k + i] *= scale;
+        }
+        bias[row] = beta.data[row] - mean.data[row] * scale;
+    }
+    return make_layer(weight, bias, m, k, kernel);
+}
+
+NativeNetwork::Layer NativeNetwork::linear(const std::string &name) const {
+    const Tensor &w = get(name + ".weight"), &b = get(name + ".bias");
+    if (w.shape.size() != 2 || b.data.size() != w.shape[0]) {
+        throw std::runtime_error("unexpected shape of " + name);
+    }
+    return make_layer(w.data, b.data, w.shape[0], w.shape[1], 1);
+}
+
+/*
+    symmetric per-row quantization to [-127, 127]
+    the products of two such values summed in pairs cannot overflow the int16 multiply-add
+*/
+void NativeNetwork::quantize(Layer &layer) {
+    int panels = (layer.m + 3) / 4, k2 = (layer.k + 1) / 2;
+    layer.packed_q.assign(panels * k2 * 8, 0);
+    layer.scale_q.assign(panels * 4, 0.0f);
+    for (int row = 0; row < layer.m; ++row) {
+        const float *w = &layer.weight[row * layer.k];
+        float max = 0;
+        for (int i = 0; i < layer.k; ++i) {
+            max = std::max(max, std::abs(w[i]));
+        }
+        float scale = max > 0 ? max / 127 : 1.0f;
+        layer.scale_q[row] = scale;
+        for (int i = 0; i < layer.k; ++i) {
+            int16_t q = static_cast<int16_t>(std::lround(w[i] / scale));
+            layer.packed_q[(((row / 4) * k2 + i / 2) * 4 + row % 4) * 2 + i % 2] = q;
+        }
+    }
+}
+
+void NativeNetwork::set_quantized(bool quantized) {
+    this->quantized = quantized;
+    for (auto &block : blocks) {
+        for (Layer *layer : {&block.conv1, &block.conv2, &block.downsample}) {
+            if (quantized && layer->m > 0) {
+                quantize(*layer);
+            }
+            else {
+                layer->packed_q.clear();
+                layer->scale_q.clear();
+            }
+        }
+    }
+}
+
+void NativeNetwork::gemm(const Layer &layer, const float *in, float *out, int cols) const {
+    auto kernel = gemm_panel;
+#ifdef NATIVE_NETWORK_AVX2
+    if (has_avx2()) {
+        kernel = gemm_panel_avx2;
+    }
+#endif
+    for (int row = 0; row < layer.m; row += 4) {
+        kernel(&layer.packed[row * layer.k], &layer.bias[row], layer.k, in, cols, out + row * cols, cols,
+            std::min(4, layer.m - row), false);
+    }
+}
+
+/*
+    the im2col matrix of the whole batch [layer.k, cols] is never built, each block of it is
+    gathered from in through the shifts just before the kernels stream it, so a block is read
+    from l2 by every panel of the layer while the weights are read once per block of columns
+    row c * 9 + dy * 3 + dx of a 3x3 convolution is channel c shifted by (dy - 1, dx - 1),
+    matching the weight layout
+*/
+void NativeNetwork::conv(const Layer &layer, const float *in, float *out) {
+    bool q = !layer.packed_q.empty();
+    int channels = layer.k / (layer.kernel * layer.kernel);
+    if (q) { // one scale per board, so the output of a row is its int32 sum times weight scale times board scale
+        int size = n * n;
+        std::fill(col_scale.begin(), col_scale.end(), 0.0f);
+        std::fill(col_inv.begin(), col_inv.end(), 0.0f);
+        for (int b = 0; b * size < live_cols; ++b) {
+            float max = 0;
+            for (int c = 0; c < channels; ++c) {
+                const float *src = in + c * cols + b * size;
+                for (int pos = 0; pos < size; ++pos) {
+                    max = std::max(max, std::abs(src[pos]));
+                }
+            }
+            float scale = max > 0 ? max / 127 : 1.0f;
+            std::fill(&col_scale[b * size], &col_scale[b * size] + size, scale);
+            std::fill(&col_inv[b * size], &col_inv[b * size] + size, 1 / scale);
+        }
+    }
+    auto kernel = gemm_panel;
+    auto kernel_q = gemm_panel_q;
+#ifdef NATIVE_NETWORK_AVX2
+    if (has_avx2()) {
+        kernel = gemm_panel_avx2;
+        kernel_q = gemm_panel_q_avx2;
+    }
+#endif
+    int k2 = (layer.k + 1) / 2;
+    for (int j0 = 0; j0 < cols; j0 += block_cols) {
+        int nb = std::min(block_cols, cols - j0);
+        for (int k0 = 0; k0 < layer.k; k0 += block_k) {
+            int kb = std::min(block_k, layer.k - k0);
+            for (int i = k0; i < k0 + kb; ++i) {
+                int d = layer.kernel == 3 ? i % 9 : 4;  // 4 is the unshifted center
+                const int *idx = &shifts[d * cols + j0];
+                const float *src = in + (layer.kernel == 3 ? i / 9 : i) * cols;
+                if (q) {
+                    int16_t *dst = &block_q[((i - k0) / 2) * nb * 2 + (i - k0) % 2];
+                    const float *inv = &col_inv[j0];
+                    for (int c = 0; c < nb; ++c) {
+                        float x = src[idx[c]] * inv[c];
+                        dst[c * 2] = static_cast<int16_t>(x + (x >= 0 ? 0.5f : -0.5f));
+                    }
+                }
+                else {
+                    float *dst = &block[(i - k0) * nb];
+                    for (int c = 0; c < nb; ++c) {
+                        dst[c] = src[idx[c]];
+                    }
+                }
+            }
+            bool accumulate = k0 > 0;
+            if (q) {
+                if (kb % 2 == 1) { // the second half of the last pair
+                    int16_t *dst = &block_q[(kb / 2) * nb * 2 + 1];
+                    for (int c = 0; c < nb; ++c) {
+                        dst[c * 2] = 0;
+                    }
+                }
+                for (int row = 0; row < layer.m; row += 4) {
+                    kernel_q(&layer.packed_q[((row / 4) * k2 + k0 / 2) * 8], &layer.scale_q[row], &col_scale[j0],
+                        &layer.bias[row], (kb + 1) / 2, block_q.data(), nb, out + row * cols + j0, cols,
+                        std::min(4, layer.m - row), accumulate);
+                }
+            }
+            else {
+                for (int row = 0; row < layer.m; row += 4) {
+                    kernel(&layer.packed[row * layer.k + k0 * 4], &layer.bias[row], kb, block.data(), nb,
+                        out + row * cols + j0, cols, std::min(4, layer.m - row), accumulate);
+                }
+            }
+        }
+    }
+    for (int row = 0; row < layer.m; ++row) { // keep the padding zero for the shifts off a board
+        std::fill(out + row * cols + live_cols, out + (row + 1) * cols, 0.0f);
+    }
+}
+
+/*
+    the tower runs once for the whole batch, board b in columns b * n * n .. (b + 1) * n * n,
+    the fully connected heads run once for the whole batch with the boards as columns
+*/
+void NativeNetwork::forward(const float *input, unsigned batch, float *prob, float *value) {
+    int size = n * n;
+    live_cols = static_cast<int>(batch) * size;
+    cols = round_up(live_cols + 1, 16);  // at least one column of padding, which stays zero
+    size_t max_channels = std::max({n_channels, p_conv.m, v_conv.m, 4});
+    for (auto &buffer : act) {
+        buffer.resize(std::max(buffer.size(), max_channels * cols));
+    }
+    col_scale.resize(cols);
+    col_inv.resize(cols);
+    // source column of every column under each of the 9 shifts, the first padding column where it falls off its board
+    shifts.resize(9 * static_cast<size_t>(cols));
+    for (int d = 0; d < 9; ++d) {
+        int dy = d / 3 - 1, dx = d % 3 - 1;
+        for (int j = 0; j < cols; ++j) {
+            int y = j % size / n + dy, x = j % n + dx;
+            bool inside = j < live_cols && y >= 0 && y < n && x >= 0 && x < n;
+            shifts[d * cols + j] = inside ? j - j % size + y * n + x : live_cols;
+        }
+    }
+
+    float *x = act[0].data();
+    for (int c = 0; c < 4; ++c) {
+        for (unsigned b = 0; b < batch; ++b) {
+            std::copy(input + (b * 4 + c) * size, input + (b * 4 + c + 1) * size, x + c * cols + b * size);
+        }
+        std::fill(x + c * cols + live_cols, x + (c + 1) * cols, 0.0f);
+    }
+    for (const Block &block : blocks) {
+        float *h = act[1].data(), *y = act[2].data();
+        conv(block.conv1, x, h);
+        relu(h, static_cast<size_t>(block.conv1.m) * cols);
+        conv(block.conv2, h, y);
+        const float *residual = x;
+        if (block.has_downsample) {
+            conv(block.downsample, x, h);
+            residual = h;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(block.conv2.m) * cols; ++i) {
+            y[i] = std::max(y[i] + residual[i], 0.0f);
+        }
+        act[0].swap(act[2]);
+        x = act[0].data();
+    }
+
+    // heads, flattened channel-major like view(batch, -1)
+    int batch_cols = round_up(static_cast<int>(batch), 16);
+    p_features.assign(static_cast<size_t>(p_fc.k) * batch_cols, 0.0f);
+    v_features.assign(static_cast<size_t>(v_fc1.k) * batch_cols, 0.0f);
+    for (auto head : {std::make_pair(&p_conv, &p_features), std::make_pair(&v_conv, &v_features)}) {
+        float *h = act[1].data();
+        conv(*head.first, x, h);
+        for (int c = 0; c < head.first->m; ++c) {
+            for (unsigned b = 0; b < batch; ++b) {
+                for (int pos = 0; pos < size; ++pos) {
+                    (*head.second)[(c * size + pos) * batch_cols + b] = std::max(h[c * cols + b * size + pos], 0.0f);
+                }
+            }
+        }
+    }
+
+    p_out.resize(static_cast<size_t>(n_actions) * batch_cols);
+    gemm(p_fc, p_features.data(), p_out.data(), batch_cols);
+    for (unsigned b = 0; b < batch; ++b) { // softmax, the exp of the log_softmax of the model
+        float max = -INFINITY, sum = 0;
+        for (int a = 0; a < n_actions; ++a) {
+            max = std::max(max, p_out[a * batch_cols + b]);
+        }
+        for (int a = 0; a < n_actions; ++a) {
+            prob[b * n_actions + a] = std::exp(p_out[a * batch_cols + b] - max);
+            sum += prob[b * n_actions + a];
+        }
+        for (int a = 0; a < n_actions; ++a) {
+            prob[b * n_actions + a] /= sum;
+        }
+    }
+
+    v_hidden.resize(static_cast<size_t>(v_fc1.m) * batch_cols);
+    v_out.resize(batch_cols);
+    gemm(v_fc1, v_features.data(), v_hidden.data(), batch_cols);
+    relu(v_hidden.data(), v_hidden.size());
+    gemm(v_fc2, v_hidden.data(), v_out.data(), batch_cols);
+    for (unsigned b = 0; b < batch; ++b) {
+        value[b] = std::tanh(v_out[b]);
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdint>
+
+/*
+    cpu forward pass of the policy value network in neural_network.py, without libtorch
+    weights are read from the .weights file written by NeuralNetWorkWrapper.save_model,
+    batch norms are folded into the convolutions in front of them at load time
+    convolutions run as im2col and a register-tiled matrix product over all boards of a batch,
+    the avx2 kernels are picked at runtime if the cpu has them, a portable kernel is used otherwise
+
+    file layout: magic "AZWEIGHT", uint32 version, uint32 n_tensors, then per tensor
+        uint32 name_len, char name[name_len], uint32 n_dims, uint32 dims[n_dims], float data[]
+    names and shapes are those of the pytorch state_dict
+*/
+class NativeNetwork {
+public:
+    explicit NativeNetwork(const std::string &path);
+
+    /*
+        run the 3x3 convolutions of the residual tower with int8 weights and activations
+        weights are scaled per output channel, activations per board, the heads stay in float
+    */
+    void set_quantized(bool quantized);
+    bool get_is_quantized() const { return quantized; }
+    int get_n() const { return n; }
+
+    /*
+        input [batch, 4, n, n], prob [batch, n * n] as probabilities, value [batch]
+        scratch buffers are reused, so calls must not overlap
+    */
+    void forward(const float *input, unsigned batch, float *prob, float *value);
+private:
+    struct Tensor {
+        std::vector<uint32_t> shape;
+        std::vector<float> data;
+    };
+
+    /*
+        a convolution or linear layer as a matrix product, out[m, cols] = weight[m, k] * in[k, cols] + bias
+        rows are packed in panels of 4, k-major inside a panel, so a kernel streams one panel
+        for the int8 kernel, pairs of k are interleaved as int16 for a 16-bit multiply-add
+    */
+    struct Layer {
+        int m = 0;
+        int k = 0;
+        int kernel = 1;                    // 3 for 3x3 convolutions (k = channels * 9), else 1
+        std::vector<float> weight;         // [m, k], kept for quantization
+        std::vector<float> packed;         // [panels, k, 4]
+        std::vector<float> bias;           // [panels * 4]
+        std::vector<int16_t> packed_q;     // [panels, k / 2, 4, 2], empty unless quantized
+        std::vector<float> scale_q;        // [panels * 4]
+    };
+
+    struct Block {
+        Layer conv1;
+        Layer conv2;
+        Layer downsample;
+        bool has_downsample = false;
+    };
+
+    static Layer make_layer(const std::vector<float> &weight, const std::vector<float> &bias, int m, int k, int kernel);
+    // convolution without bias followed by batch norm
+    Layer fold(const std::string &conv, const std::string &bn, int kernel) const;
+    Layer linear(const std::string &name) const;
+    const Tensor &get(const std::string &name) const;
+    static void quantize(Layer &layer);
+
+    // in [layer.k / kernel^2, cols] -> out [layer.m, cols], in int8 if the layer is quantized
+    void conv(const Layer &layer, const float *in, float *out);
+    // the fully connected layers
+    void gemm(const Layer &layer, const float *in, float *out, int cols) const;
+
+    std::map<std::string, Tensor> tensors;  // only while loading
+    int n = 0;
+    int n_channels = 0;
+    int n_actions = 0;
+    bool quantized = false;
+    std::vector<Block> blocks;
+    Layer p_conv, p_fc, v_conv, v_fc1, v_fc2;
+
+    // scratch, the tower has batch * n * n columns and at least one zero column of padding to a multiple of 16
+    int live_cols = 0;
+    int cols = 0;
+    std::vector<float> act[3];           // [channels, cols]
+    std::vector<int> shifts;             // [9, cols]
+    std::vector<float> block;            // [block_k, block_cols] of the im2col matrix
+    std::vector<int16_t> block_q;        // [block_k / 2, block_cols, 2]
+    std::vector<float> col_scale, col_inv;  // int8 scale of the board of a column
+    std::vector<float> p_features, v_features, p_out, v_hidden, v_out;
+};
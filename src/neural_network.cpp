@@ -1,90 +1,572 @@
 #include "neural_network.h"
+#include "symmetry.h"
+#include "inference_daemon.h"
 #include <utility>
+#include <algorithm>
+#include <thread>
+#include <random>
+#include <stdexcept>
 
-using namespace std::chrono_literals;
+constexpr unsigned NeuralNetwork::n_batches_in_ring;
+constexpr unsigned NeuralNetwork::closed;
+
+NeuralNetwork::Evaluation &NeuralNetwork::Evaluation::operator=(Evaluation &&other) noexcept {
+    if (this != &other) {
+        release();
+        batch = other.batch;
+        slot = other.slot;
+        prob = std::move(other.prob);
+        value = other.value;
+        other.batch = nullptr;
+    }
+    return *this;
+}
+
+void NeuralNetwork::Evaluation::release() {
+    if (batch != nullptr) {
+        wait(); // the slot must not be reused while the batch is running
+        // the server does not run into a buffer still in use, wake it once the last slot is free
+        if (batch->n_released.fetch_add(1) + 1 == batch->n_items && batch->owner->server->waiting.load()) {
+            batch->owner->notify_infer();
+        }
+        batch = nullptr;
+    }
+}
+
+void NeuralNetwork::Evaluation::wait() const {
+    if (batch != nullptr) {
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->cv.wait(lock, [this]() {
+            return batch->done;
+        });
+    }
+}
+
+const float *NeuralNetwork::Evaluation::get_prob() const {
+    if (batch == nullptr) {
+        return prob.data();
+    }
+    wait();
+    return static_cast<const float*>(batch->prob.data_ptr()) + slot * batch->prob.size(1);
+}
+
+float NeuralNetwork::Evaluation::get_value() const {
+    if (batch == nullptr) {
+        return value;
+    }
+    wait();
+    return static_cast<const float*>(batch->value.data_ptr())[slot];
+}
 
 /*
     in torch1.2.0, module is ref instead of ptr
 */
-NeuralNetwork::NeuralNetwork(std::string model_path, bool use_gpu, unsigned batch_size) :
-    module(torch::jit::load(model_path.c_str())), use_gpu(use_gpu), batch_size(batch_size), 
-    running(true), loop(nullptr) {
-    if (use_gpu) {
-        module.to(at::kCUDA);
+NeuralNetwork::NeuralNetwork(std::string model_path, bool use_gpu, unsigned batch_size, size_t cache_size,
+    InferenceServer *server) : server(server), use_gpu(use_gpu), batch_size(batch_size) {
+    load_model(model_path);
+    set_cache_size(cache_size);
+    if (this->server == nullptr) {
+        own_server.reset(new InferenceServer());
+        this->server = own_server.get();
     }
-    loop = std::make_unique<std::thread>([this]() {
-        while (running.load()) {
-            infer();
-        }
-    });
+    this->server->add(this);
 }
 
 NeuralNetwork::~NeuralNetwork() {
-    running.store(false);
-    loop->join();
+    server->remove(this);
 }
 
-std::future<NeuralNetwork::return_type> NeuralNetwork::commit(const Board &board) {
-    int n = board.get_n();
-    const auto raw_states = board.get_encode_states();
-    std::vector<int> states1D;
-    for (const auto &vc1 : raw_states) {
-        for (const auto &vc2 : vc1) {
-            states1D.insert(states1D.end(), vc2.cbegin(), vc2.cend());
-        }
-    }
-    // get input states
-    torch::Tensor states = torch::from_blob(&states1D[0], {1, 4, n, n}, 
-        torch::dtype(torch::kInt32)).toType(torch::kFloat32);
-    std::promise<return_type> promise;
-    auto res = promise.get_future();
+InferenceServer::InferenceServer() : worker([this]() { run(); }) { }
+
+InferenceServer::~InferenceServer() {
     {
-        std::lock_guard<std::mutex> lock(this->lock);
-        tasks.emplace(std::make_pair(states, std::move(promise)));
-        cv.notify_all();
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
     }
-    return res;
+    cv.notify_all();
+    worker.join();
+}
+
+void InferenceServer::add(NeuralNetwork *model) {
+    std::lock_guard<std::mutex> lock(mutex);
+    models.push_back({model, 1.0, clock});
+    cv.notify_all();
+}
+
+void InferenceServer::remove(NeuralNetwork *model) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() {
+        return running != model;
+    });
+    models.erase(std::remove_if(models.begin(), models.end(), [&](const Entry &entry) {
+        return entry.model == model;
+    }), models.end());
+}
+
+void InferenceServer::set_priority(NeuralNetwork *model, double priority) {
+    if (!(priority > 0)) {
+        throw std::invalid_argument("priority must be positive");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &entry : models) {
+        if (entry.model == model) {
+            entry.priority = priority;
+        }
+    }
+}
+
+void InferenceServer::notify() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cv.notify_all();
 }
 
-void NeuralNetwork::infer() {
-    std::vector<torch::Tensor> states;
-    std::vector<std::promise<return_type>> promises;
-    bool timeout = false;
-    while (states.size() < batch_size && !timeout) {
-        {
-            std::unique_lock<std::mutex> lock(this->lock);
-            if (cv.wait_for(lock, 1ms, [this]() {
-                return tasks.size() > 0;
-            })) {
-                auto task = std::move(tasks.front());
-                states.emplace_back(std::move(task.first));
-                promises.emplace_back(std::move(task.second));
-                tasks.pop();
+/*
+    weighted fair scheduling over the models with a due batch
+    every model has a virtual time that advances by boards run / priority, the due model
+    with the smallest virtual time runs next, and a model that was idle starts at the clock,
+    so it cannot claim the worker for the time it did not use
+
+    waiting is set before the models are polled, and submit marks its slot ready before it reads waiting,
+    so either the worker sees the new board or submit sees waiting and notifies under the lock
+*/
+void InferenceServer::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop) {
+        waiting.store(true);
+        auto now = std::chrono::steady_clock::now();
+        auto wake = std::chrono::steady_clock::time_point::max();
+        Entry *next = nullptr;
+        for (auto &entry : models) {
+            auto deadline = wake;
+            if (entry.model->poll(now, deadline)) {
+                entry.vtime = std::max(entry.vtime, clock);
+                if (next == nullptr || entry.vtime < next->vtime) {
+                    next = &entry;
+                }
+            }
+            wake = std::min(wake, deadline);
+        }
+        if (next == nullptr) {
+            if (wake == std::chrono::steady_clock::time_point::max()) {
+                cv.wait(lock);
             }
             else {
-                timeout = true;
+                cv.wait_until(lock, wake);
+            }
+            continue;
+        }
+        waiting.store(false);
+        NeuralNetwork *model = next->model;
+        clock = next->vtime;
+        running = model;
+        lock.unlock();
+        unsigned items = model->run_batch();
+        lock.lock();
+        running = nullptr;
+        for (auto &entry : models) { // the entry may have moved while unlocked
+            if (entry.model == model) {
+                entry.vtime += items / entry.priority;
             }
         }
+        cv.notify_all(); // remove() may wait for this model
+    }
+}
+
+void NeuralNetwork::load_model(std::string model_path) {
+    const std::string suffix = ".weights", prefix = "shm:";
+    torch::jit::script::Module new_module;
+    std::unique_ptr<NativeNetwork> new_native;
+    std::shared_ptr<InferenceClient> new_remote;
+    if (model_path.compare(0, prefix.size(), prefix) == 0) {
+        new_remote = std::make_shared<InferenceClient>(model_path.substr(prefix.size()));
+    }
+    else if (model_path.size() >= suffix.size() && model_path.compare(model_path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        new_native.reset(new NativeNetwork(model_path));
+    }
+    else {
+        new_module = torch::jit::load(model_path.c_str());
+        if (use_gpu) {
+            new_module.to(at::kCUDA);
+        }
     }
-    if (states.empty()) {
-        return;
-    }
-    // prepare input
-    std::vector<torch::jit::IValue> inputs{
-        use_gpu ? torch::cat(states, 0).to(at::kCUDA) : torch::cat(states, 0)
-    };
-    // get result from nn
-    auto res = module.forward(inputs).toTuple();
-    // log_softmax probability, so exp() is needed
-    torch::Tensor p_batch = res->elements()[0].toTensor().exp().toType(torch::kFloat32).to(at::kCPU);
-    torch::Tensor v_batch = res->elements()[1].toTensor().toType(torch::kFloat32).to(at::kCPU);
-    for (unsigned i = 0; i < promises.size(); ++i) {
-        torch::Tensor p = p_batch[i];
-        torch::Tensor v = v_batch[i];
-        std::vector<double> prob(static_cast<float*>(p.data_ptr()), 
-            static_cast<float*>(p.data_ptr()) + p.size(0));
-        std::vector<double> value{v.item<float>()};
-        return_type temp{std::move(prob), std::move(value)};
-        promises[i].set_value(std::move(temp));
-    }
-}
\ No newline at end of file
+    std::lock_guard<std::mutex> lock(module_mutex);
+    if (new_native) {
+        if (n != 0 && new_native->get_n() != n) {
+            throw std::invalid_argument("model " + model_path + " is for another board size");
+        }
+        new_native->set_quantized(quantized);
+    }
+    if (new_remote && n != 0 && new_remote->get_n() != n) {
+        throw std::invalid_argument("model " + model_path + " is for another board size");
+    }
+    module = new_module;
+    native = std::move(new_native);
+    std::atomic_store(&remote, new_remote);
+    if (cache) {
+        cache->clear();
+    }
+}
+
+void NeuralNetwork::set_quantized(bool quantized) {
+    std::lock_guard<std::mutex> lock(module_mutex);
+    this->quantized = quantized;
+    if (native) {
+        native->set_quantized(quantized);
+        if (cache) {
+            cache->clear();
+        }
+    }
+}
+
+void NeuralNetwork::set_cache_size(size_t cache_size) {
+    std::lock_guard<std::mutex> lock(module_mutex);
+    cache.reset(cache_size > 0 ? new LRUCache<CacheEntry>(cache_size) : nullptr);
+}
+
+/*
+    the batch buffers are allocated on first use, when the board size is known
+*/
+void NeuralNetwork::init_batches(int n) {
+    {
+        std::lock_guard<std::mutex> lock(module_mutex);
+        if (native && native->get_n() != n) {
+            throw std::invalid_argument("the model is for another board size");
+        }
+    }
+    this->n = n;
+    capacity = std::max(2 * batch_size, 8u);
+    batches.reset(new Batch[n_batches_in_ring]);
+    for (unsigned i = 0; i < n_batches_in_ring; ++i) {
+        Batch &batch = batches[i];
+        batch.owner = this;
+        batch.input = torch::zeros({static_cast<long>(capacity), 4, n, n}, torch::dtype(torch::kFloat32));
+        batch.commit_times.resize(capacity);
+        batch.keys.resize(capacity);
+        batch.transforms.resize(capacity);
+        batch.input_transforms.resize(capacity);
+        batch.groups.resize(capacity);
+        batch.promises.resize(capacity);
+    }
+    current.store(&batches[0]);
+    notify_infer(); // the server does not poll this network before its first batch buffer
+}
+
+/*
+    positions equal up to symmetry share one cache entry
+    on a hit, prob is filled in the orientation of the board
+*/
+bool NeuralNetwork::lookup_cache(const Board &board, uint64_t &key, int &transform, std::vector<float> &prob, float &value) {
+    if (!cache) {
+        return false;
+    }
+    std::tie(key, transform) = Symmetry::get_canonical_hash(board);
+    CacheEntry entry;
+    if (!cache->get(key, entry)) {
+        return false;
+    }
+    int size = board.get_board_size();
+    const auto &table = Symmetry::get_table(board.get_n(), transform);
+    prob.resize(size);
+    for (int i = 0; i < size; ++i) {
+        prob[i] = entry.prob[table[i]];
+    }
+    value = entry.value;
+    return true;
+}
+
+NeuralNetwork::Batch *NeuralNetwork::submit(const Board &board, uint64_t key, int transform,
+    std::unique_ptr<std::promise<return_type>> promise, unsigned &slot) {
+    std::call_once(batches_flag, [&]() {
+        init_batches(board.get_n());
+    });
+    // the symmetries to evaluate the board under, all in consecutive slots of one batch
+    unsigned k = std::max(symmetry_samples, 1u);
+    int input_transforms[Symmetry::n_symmetries] = {0, 1, 2, 3, 4, 5, 6, 7};
+    if (symmetry_samples > 0) {
+        thread_local std::mt19937 rng(std::random_device{}());
+        for (unsigned i = 0; i < k; ++i) { // partial fisher-yates shuffle
+            std::swap(input_transforms[i], input_transforms[i + rng() % (Symmetry::n_symmetries - i)]);
+        }
+    }
+
+    Batch *batch = nullptr;
+    while (true) {
+        batch = current.load();
+        slot = batch->n_claimed.fetch_add(k);
+        if (slot + k <= capacity) {
+            break;
+        }
+        if (slot < capacity) { // the claim straddles the end, the slots left are run empty
+            for (unsigned i = slot; i < capacity; ++i) {
+                batch->groups[i] = 0;
+                batch->input_transforms[i] = -1; // no board, and no commit time
+                batch->promises[i].reset();
+            }
+            batch->n_ready.fetch_add(capacity - slot);
+        }
+        // full or closed, let the server move on to the next batch
+        notify_infer();
+        std::this_thread::yield();
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < k; ++i) {
+        Symmetry::encode(board, input_transforms[i], static_cast<float*>(batch->input.data_ptr()) + (slot + i) * 4 * n * n);
+        batch->commit_times[slot + i] = now;
+        batch->input_transforms[slot + i] = input_transforms[i];
+        batch->groups[slot + i] = 0;
+        batch->promises[slot + i].reset();
+    }
+    batch->groups[slot] = k;
+    batch->keys[slot] = key;
+    batch->transforms[slot] = transform;
+    batch->promises[slot] = std::move(promise);
+    batch->n_ready.fetch_add(k);
+    // only take the lock if the server may be sleeping
+    if (server->waiting.load()) {
+        notify_infer();
+    }
+    return batch;
+}
+
+std::future<NeuralNetwork::return_type> NeuralNetwork::commit(const Board &board) {
+    uint64_t key = 0;
+    int transform = 0;
+    std::vector<float> prob;
+    float value;
+    auto client = std::atomic_load(&remote);
+    if (client) {
+        client->evaluate(board, prob, value);
+    }
+    if (client || lookup_cache(board, key, transform, prob, value)) {
+        std::promise<return_type> promise;
+        promise.set_value(return_type{std::vector<double>(prob.begin(), prob.end()), {value}});
+        return promise.get_future();
+    }
+    std::unique_ptr<std::promise<return_type>> promise(new std::promise<return_type>());
+    auto res = promise->get_future();
+    unsigned slot;
+    submit(board, key, transform, std::move(promise), slot);
+    return res;
+}
+
+NeuralNetwork::Evaluation NeuralNetwork::evaluate(const Board &board) {
+    Evaluation res;
+    auto client = std::atomic_load(&remote);
+    if (client) {
+        client->evaluate(board, res.prob, res.value);
+        return res;
+    }
+    uint64_t key = 0;
+    int transform = 0;
+    if (!lookup_cache(board, key, transform, res.prob, res.value)) {
+        res.batch = submit(board, key, transform, nullptr, res.slot);
+    }
+    return res;
+}
+
+void NeuralNetwork::notify_infer() {
+    server->notify();
+}
+
+void NeuralNetwork::set_priority(double priority) {
+    server->set_priority(this, priority);
+}
+
+/*
+    called by the server with its lock held
+    a batch is due when the target batch size is reached, the buffer is full,
+    or max_wait_us passed since the server first saw a board in it
+    it is never due while the next buffer in the ring still has unreleased evaluations,
+    the last release wakes the server instead, so a slow consumer does not hold the worker
+*/
+bool NeuralNetwork::poll(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &deadline) {
+    Batch *batch = current.load();
+    if (batch == nullptr || batch->n_ready.load() == 0) {
+        has_pending = false;
+        return false;
+    }
+    if (!has_pending) {
+        has_pending = true;
+        pending_since = now;
+    }
+    const Batch &next = batches[(current_index + 1) % n_batches_in_ring];
+    if (next.n_released.load() < next.n_items) {
+        return false;
+    }
+    unsigned target = std::min(std::max(batch_size, 1u), capacity);
+    deadline = pending_since + std::chrono::microseconds(max_wait_us);
+    return batch->n_ready.load() >= target || batch->n_claimed.load() >= capacity || now >= deadline;
+}
+
+/*
+    run the current batch, return the number of boards in it
+    committing threads are switched to the next buffer in the ring first, then the closed one is run
+*/
+unsigned NeuralNetwork::run_batch() {
+    Batch *batch = current.load();
+    has_pending = false;
+    unsigned target = std::min(std::max(batch_size, 1u), capacity);
+
+    // poll made sure every evaluation of the previous run of the next buffer is released
+    current_index = (current_index + 1) % n_batches_in_ring;
+    Batch *next = &batches[current_index];
+    next->n_ready.store(0);
+    next->n_released.store(0);
+    next->n_items = 0;
+    {
+        std::lock_guard<std::mutex> lock(next->mutex);
+        next->done = false;
+    }
+    next->n_claimed.store(0); // reset last, claims are valid from here on
+    current.store(next);
+
+    unsigned items = std::min(batch->n_claimed.fetch_add(closed), capacity);
+    while (batch->n_ready.load() < items) { // wait for threads still encoding
+        std::this_thread::yield();
+    }
+    batch->n_items = items;
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t latency = 0;
+    // statistics count boards, the fill ratio network rows, padding is run but counted in neither
+    unsigned n_boards = 0, n_live_rows = 0;
+    for (unsigned i = 0; i < items; ++i) {
+        if (batch->input_transforms[i] < 0) { // padding, its commit time is from an earlier run
+            continue;
+        }
+        ++n_live_rows;
+        if (batch->groups[i] == 0) { // another symmetry sample of the board before
+            continue;
+        }
+        ++n_boards;
+        uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(start - batch->commit_times[i]).count();
+        latency += wait;
+        telemetry.record(stat_queue_us, wait / 1000);
+    }
+    telemetry.add(stat_batches);
+    telemetry.add(stat_items, n_boards);
+    telemetry.record(stat_batch_size, n_boards);
+    ++n_batches;
+    n_items += n_boards;
+    n_rows += n_live_rows;
+    n_capacity += std::max(target, n_live_rows);
+    queue_latency_ns += latency;
+
+    {
+        // the cache is filled under the same lock, so results of a replaced model never enter it
+        std::lock_guard<std::mutex> lock(module_mutex);
+        auto forward_start = std::chrono::steady_clock::now();
+        if (native) {
+            // outputs are written in place, into tensors kept across runs
+            if (!batch->prob.defined() || batch->prob.size(0) != static_cast<long>(capacity)) {
+                batch->prob = torch::zeros({static_cast<long>(capacity), n * n}, torch::dtype(torch::kFloat32));
+                batch->value = torch::zeros({static_cast<long>(capacity), 1}, torch::dtype(torch::kFloat32));
+            }
+            native->forward(static_cast<const float*>(batch->input.data_ptr()), items,
+                static_cast<float*>(batch->prob.data_ptr()), static_cast<float*>(batch->value.data_ptr()));
+        }
+        else {
+            torch::Tensor input = batch->input.narrow(0, 0, items);
+            std::vector<torch::jit::IValue> inputs{
+                use_gpu ? input.to(at::kCUDA) : input
+            };
+            // get result from nn
+            auto res = module.forward(inputs).toTuple();
+            // log_softmax probability, so exp() is needed
+            batch->prob = res->elements()[0].toTensor().exp().toType(torch::kFloat32).to(at::kCPU).contiguous();
+            batch->value = res->elements()[1].toTensor().toType(torch::kFloat32).to(at::kCPU).contiguous();
+        }
+        telemetry.record(stat_forward_us, std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - forward_start).count());
+
+        float *p_data = static_cast<float*>(batch->prob.data_ptr());
+        float *v_data = static_cast<float*>(batch->value.data_ptr());
+        int size = n * n;
+        prob_sum.resize(size);
+        prob_tmp.resize(size);
+        unsigned n_leaders = 0;
+        for (unsigned i = 0; i < items; ++i) {
+            unsigned group = batch->groups[i];
+            if (group == 0) { // part of another board, or an empty slot
+                continue;
+            }
+            ++n_leaders;
+            // map every symmetry back to the orientation of the board and average into the first slot
+            float *prob = p_data + i * size;
+            if (group > 1 || batch->input_transforms[i] != 0) {
+                std::fill(prob_sum.begin(), prob_sum.end(), 0.0f);
+                float value_sum = 0;
+                for (unsigned j = i; j < i + group; ++j) {
+                    Symmetry::transform(n, Symmetry::inverse(batch->input_transforms[j]), p_data + j * size, 1, prob_tmp.data());
+                    for (int pos = 0; pos < size; ++pos) {
+                        prob_sum[pos] += prob_tmp[pos];
+                    }
+                    value_sum += v_data[j];
+                }
+                for (int pos = 0; pos < size; ++pos) {
+                    prob[pos] = prob_sum[pos] / group;
+                }
+                v_data[i] = value_sum / group;
+            }
+            if (cache) {
+                const auto &table = Symmetry::get_table(n, batch->transforms[i]);
+                CacheEntry entry{std::vector<float>(size), v_data[i]};
+                for (int j = 0; j < size; ++j) {
+                    entry.prob[table[j]] = prob[j];
+                }
+                cache->put(batch->keys[i], std::move(entry));
+            }
+            if (batch->promises[i]) { // committed through the future interface
+                batch->promises[i]->set_value(return_type{std::vector<double>(prob, prob + size), {v_data[i]}});
+                batch->promises[i].reset();
+                batch->n_released.fetch_add(1);
+            }
+        }
+        // only first slots are released by their evaluations
+        batch->n_released.fetch_add(items - n_leaders);
+    }
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->done = true;
+    }
+    batch->cv.notify_all();
+    return items;
+}
+
+double NeuralNetwork::get_avg_batch_size() const {
+    uint64_t batches = n_batches.load();
+    return batches == 0 ? 0.0 : static_cast<double>(n_items.load()) / batches;
+}
+
+double NeuralNetwork::get_batch_fill_ratio() const {
+    uint64_t capacity = n_capacity.load();
+    return capacity == 0 ? 0.0 : static_cast<double>(n_rows.load()) / capacity;
+}
+
+double NeuralNetwork::get_avg_queue_latency_us() const {
+    uint64_t items = n_items.load();
+    return items == 0 ? 0.0 : queue_latency_ns.load() / 1000.0 / items;
+}
+
+void NeuralNetwork::reset_batch_stats() {
+    n_batches.store(0);
+    n_items.store(0);
+    n_rows.store(0);
+    n_capacity.store(0);
+    queue_latency_ns.store(0);
+}
+
+std::map<std::string, double> NeuralNetwork::get_stats() const {
+    auto res = telemetry.snapshot();
+    res["cache_hits"] = static_cast<double>(get_cache_hits());
+    res["cache_misses"] = static_cast<double>(get_cache_misses());
+    return res;
+}
+
+void NeuralNetwork::reset_stats() {
+    telemetry.reset();
+    reset_batch_stats();
+    if (cache) {
+        cache->reset_counters();
+    }
+}
@@ -1,34 +1,222 @@
 #pragma once
 #include "board.h"
+#include "lru_cache.h"
+#include "symmetry.h"
+#include "telemetry.h"
+#include "native_network.h"
 #include <torch/script.h>
 #include <vector>
 #include <string>
-#include <queue>
+#include <map>
 #include <future>
 #include <atomic>
 #include <memory>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+
+class NeuralNetwork;
+class InferenceClient;
+
+/*
+    one inference thread shared by several networks, e.g. the two models of a contest
+    every network keeps its own batch ring, the server runs whichever has a batch due,
+    sharing the thread between them in proportion to their priorities
+    a server must outlive its networks
+*/
+class InferenceServer {
+public:
+    InferenceServer();
+    ~InferenceServer();
+
+    InferenceServer(const InferenceServer &) = delete;
+    InferenceServer &operator=(const InferenceServer &) = delete;
+private:
+    friend class NeuralNetwork;
+
+    struct Entry {
+        NeuralNetwork *model;
+        double priority;
+        double vtime;     // boards run / priority
+    };
+
+    void add(NeuralNetwork *model);
+    // wait until the model is not being run, then forget it
+    void remove(NeuralNetwork *model);
+    void set_priority(NeuralNetwork *model, double priority);
+    void notify();
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<Entry> models;
+    NeuralNetwork *running = nullptr;     // model whose batch is being run
+    double clock = 0;                     // virtual time of the last batch run
+    std::atomic<bool> waiting{false};     // the worker is asleep or about to sleep
+    bool stop = false;
+    std::thread worker;                   // last, it starts after the members it uses
+};
 
 class NeuralNetwork {
+    struct Batch;
 public:
     using return_type = std::vector<std::vector<double>>;
 
-    NeuralNetwork(std::string model_path, bool use_gpu, unsigned batch_size);
+    /*
+        one evaluation in flight
+        the policy and value are read in place from the output tensors of its batch,
+        the batch buffer is reused only after every evaluation in it is destroyed
+    */
+    class Evaluation {
+    public:
+        Evaluation() = default;
+        Evaluation(Evaluation &&other) noexcept { *this = std::move(other); }
+        Evaluation &operator=(Evaluation &&other) noexcept;
+        Evaluation(const Evaluation &) = delete;
+        Evaluation &operator=(const Evaluation &) = delete;
+        ~Evaluation() { release(); }
+
+        // block until the batch has been run
+        void wait() const;
+        // n * n action probabilities
+        const float *get_prob() const;
+        float get_value() const;
+    private:
+        friend class NeuralNetwork;
+        void release();
+
+        Batch *batch = nullptr;
+        unsigned slot = 0;
+        std::vector<float> prob;  // cache hits own their result
+        float value = 0;
+    };
+
+    /*
+        cache_size is the number of cached evaluations, 0 disables the cache
+        batches are run by server, or by a private one if it is nullptr
+    */
+    NeuralNetwork(std::string model_path, bool use_gpu, unsigned batch_size, size_t cache_size = 0,
+        InferenceServer *server = nullptr);
     ~NeuralNetwork();
 
     std::future<return_type> commit(const Board &board);
+    // zero-copy variant of commit, the board is encoded straight into the batch buffer
+    Evaluation evaluate(const Board &board);
 
+    // the batch buffers hold 2 * batch_size boards from their first use on
     void set_batch_size(unsigned batch_size) { this->batch_size = batch_size; }
+    // a partial batch is flushed once it waited this long for more boards
+    void set_max_wait_us(unsigned max_wait_us) { this->max_wait_us = max_wait_us; }
+    /*
+        evaluate every board under k distinct random symmetries in one batch and average the results
+        0 evaluates the board as it is, each symmetry takes one slot of the batch
+    */
+    void set_symmetry_samples(unsigned k) { symmetry_samples = std::min(k, static_cast<unsigned>(Symmetry::n_symmetries)); }
+    // share of a shared server relative to its other networks while several have batches due, default 1
+    void set_priority(double priority);
+
+    /*
+        replace the model in place, cached evaluations of the old model are dropped
+        a .weights file runs on the native cpu backend, "shm:name" forwards every board to the
+        InferenceDaemon serving name, anything else is loaded as torchscript
+        with a daemon evaluate and commit block until the result is back
+    */
+    void load_model(std::string model_path);
+    // run the residual tower of a native model in int8, no effect on torchscript models
+    void set_quantized(bool quantized);
+
+    // must not be called while boards are being committed
+    void set_cache_size(size_t cache_size);
+    uint64_t get_cache_hits() const { return cache ? cache->get_hits() : 0; }
+    uint64_t get_cache_misses() const { return cache ? cache->get_misses() : 0; }
+
+    // batching statistics since the last reset
+    double get_avg_batch_size() const;           // boards, a board counts once whatever its symmetry samples
+    double get_batch_fill_ratio() const;         // avg of network rows / target batch size
+    double get_avg_queue_latency_us() const;     // commit to start of forward pass
+    void reset_batch_stats();
+
+    // histograms of batch_size, queue_us (per board) and forward_us (per batch), and cache counters
+    std::map<std::string, double> get_stats() const;
+    void reset_stats();
 private:
-    using task_type = std::pair<torch::Tensor, std::promise<return_type>>;
+    friend class InferenceServer;
 
-    void infer();
+    // policy in the canonical orientation of the position
+    struct CacheEntry {
+        std::vector<float> prob;
+        float value;
+    };
 
-    std::unique_ptr<std::thread> loop;
-    std::atomic<bool> running;
-    std::queue<task_type> tasks;
-    std::mutex lock;
-    std::condition_variable cv;
+    static constexpr unsigned n_batches_in_ring = 4;
+    static constexpr unsigned closed = 1u << 30; // added to n_claimed when a batch is closed
+
+    /*
+        a preallocated batch buffer
+        committing threads claim a slot, encode into input at that slot and mark it ready
+        the server thread closes the batch, runs it and publishes the outputs
+    */
+    struct Batch {
+        torch::Tensor input;                     // [capacity, 4, n, n]
+        torch::Tensor prob;                      // [n_items, n * n] on cpu
+        torch::Tensor value;                     // [n_items, 1] on cpu
+        std::atomic<unsigned> n_claimed{0};
+        std::atomic<unsigned> n_ready{0};
+        std::atomic<unsigned> n_released{0};
+        unsigned n_items = 0;                    // set when the batch is closed
+        std::vector<std::chrono::steady_clock::time_point> commit_times;
+        std::vector<uint64_t> keys;              // canonical hash for the cache
+        std::vector<int> transforms;             // symmetry from the board to the canonical orientation
+        std::vector<int> input_transforms;       // symmetry the board was encoded under, -1 for padding
+        std::vector<unsigned> groups;            // slots of one board, set on its first slot and 0 on the others
+        std::vector<std::unique_ptr<std::promise<return_type>>> promises; // set by commit
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        NeuralNetwork *owner = nullptr;          // notified when the last evaluation is released
+    };
+
+    void init_batches(int n);
+    // claim a slot in the current batch and encode the board into it
+    Batch *submit(const Board &board, uint64_t key, int transform,
+        std::unique_ptr<std::promise<return_type>> promise, unsigned &slot);
+    bool lookup_cache(const Board &board, uint64_t &key, int &transform, std::vector<float> &prob, float &value);
+    void notify_infer();
+
+    // whether the current batch is due, else deadline is when it will be
+    bool poll(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &deadline);
+    unsigned run_batch();
+
+    InferenceServer *server;
+    std::unique_ptr<InferenceServer> own_server;
+    bool has_pending = false;                // used by the server thread only
+    std::chrono::steady_clock::time_point pending_since;
+    std::once_flag batches_flag;
+    std::unique_ptr<Batch[]> batches;
+    std::atomic<Batch*> current{nullptr};
+    unsigned current_index = 0;
+    unsigned capacity = 0;                   // boards per batch buffer
+    int n = 0;                               // board size, fixed by the first commit
+    unsigned max_wait_us = 1000;
+    unsigned symmetry_samples = 0;
+    std::vector<float> prob_sum;             // scratch of the server thread
+    std::vector<float> prob_tmp;
+    std::atomic<uint64_t> n_batches{0};
+    std::atomic<uint64_t> n_items{0};          // boards
+    std::atomic<uint64_t> n_rows{0};           // network rows, k per board with k symmetry samples
+    std::atomic<uint64_t> n_capacity{0};       // sum of target batch sizes, in rows
+    std::atomic<uint64_t> queue_latency_ns{0};
+    enum { stat_batches, stat_items };
+    enum { stat_batch_size, stat_queue_us, stat_forward_us };
+    Telemetry telemetry{{"batches", "items"}, {"batch_size", "queue_us", "forward_us"}};
     torch::jit::script::Module module;
+    std::unique_ptr<NativeNetwork> native;   // used instead of module if set
+    std::shared_ptr<InferenceClient> remote; // used instead of batching if set, accessed atomically
+    bool quantized = false;
+    std::mutex module_mutex;  // held while the module is used or replaced
+    std::unique_ptr<LRUCache<CacheEntry>> cache;
     unsigned batch_size;
     bool use_gpu;
-};
\ No newline at end of file
+};
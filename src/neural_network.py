@@ -2,6 +2,7 @@
 import sys
 import os
 import random
+import struct
 
 import torch
 import torch.nn as nn
@@ -148,22 +149,22 @@ class NeuralNetWorkWrapper():
         self.optim = Adam(self.neural_network.parameters(), lr = self.lr, weight_decay = self.l2)
         self.alpha_loss = AlphaLoss()
 
-    def train(self, example_buffer, batch_size, epochs):
-        """train neural network
+    def train(self, replay_buffer, batch_size, epochs):
+        """train neural network on batches sampled from a ReplayBuffer
         """
         res = []
         for epo in range(1, epochs + 1):
             self.neural_network.train()
 
-            # sample
-            train_data = random.sample(example_buffer, batch_size)
+            # sample, each position under a random symmetry
+            replay_buffer.sample(batch_size)
 
-            # extract train data
-            state_batch, p_batch, v_batch = list(zip(*train_data))
-            state_batch = torch.Tensor(state_batch).cuda() if self.train_use_gpu else torch.Tensor(state_batch)
-            p_batch = torch.Tensor(p_batch).cuda() if self.train_use_gpu else torch.Tensor(p_batch)
-            v_batch = torch.Tensor(v_batch).unsqueeze(
-                1).cuda() if self.train_use_gpu else torch.Tensor(v_batch).unsqueeze(1)
+            # extract train data, the getters return fresh arrays that torch takes over without copying
+            state_batch = torch.from_numpy(replay_buffer.get_batch_states().reshape(batch_size, 4, self.n, self.n))
+            p_batch = torch.from_numpy(replay_buffer.get_batch_probs().reshape(batch_size, -1))
+            v_batch = torch.from_numpy(replay_buffer.get_batch_values()).unsqueeze(1)
+            if self.train_use_gpu:
+                state_batch, p_batch, v_batch = state_batch.cuda(), p_batch.cuda(), v_batch.cuda()
 
             # zero the parameter gradients
             self.optim.zero_grad()
@@ -223,6 +224,9 @@ class NeuralNetWorkWrapper():
         state = {'network' : self.neural_network.state_dict(), 'optim' : self.optim.state_dict()}
         torch.save(state, filepath)
 
+        # save weights for the native cpu backend
+        self.save_weights(filepath + '.weights')
+
         # save torchscript
         filepath += '.pt'
         self.neural_network.eval()
@@ -241,3 +245,17 @@ class NeuralNetWorkWrapper():
             self.neural_network.cuda()
         else:
             self.neural_network.cpu()
+
+    def save_weights(self, filepath):
+        """save the float tensors of the state dict in the layout read by NativeNetwork
+        """
+
+        tensors = [(name, t) for name, t in self.neural_network.state_dict().items() if t.is_floating_point()]
+        with open(filepath, 'wb') as f:
+            f.write(b'AZWEIGHT')
+            f.write(struct.pack('<II', 1, len(tensors)))
+            for name, t in tensors:
+                data = t.detach().cpu().float().contiguous().numpy()
+                f.write(struct.pack('<I', len(name)) + name.encode())
+                f.write(struct.pack('<I', data.ndim) + struct.pack('<{}I'.format(data.ndim), *data.shape))
+                f.write(data.astype('<f4').tobytes())
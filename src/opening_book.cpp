@@ -0,0 +1,179 @@
+#include "opening_book.h"
+#include "symmetry.h"
+#include "mcts.h"
+#include <stdexcept>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <tuple>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+constexpr char OpeningBook::magic[9];
+constexpr uint32_t OpeningBook::version;
+
+OpeningBook::OpeningBook(std::string path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open opening book " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot stat opening book " + path);
+    }
+    file_size = static_cast<size_t>(st.st_size);
+    if (file_size < sizeof(Header)) {
+        close(fd);
+        throw std::runtime_error("opening book " + path + " is corrupt");
+    }
+    void *addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error("cannot map opening book " + path);
+    }
+    data = static_cast<const uint8_t*>(addr);
+    header = reinterpret_cast<const Header*>(data);
+    n = static_cast<int>(header->n);
+    n_in_row = static_cast<int>(header->n_in_row);
+    if (std::memcmp(header->magic, magic, sizeof(header->magic)) != 0 || header->version != version
+        || n < 1 || n > BitBoard::max_n || header->entry_size != static_cast<uint32_t>((8 + 2 * n * n + 7) / 8 * 8)
+        || file_size != sizeof(Header) + header->n_entries * header->entry_size) {
+        munmap(const_cast<uint8_t*>(data), file_size);
+        throw std::runtime_error("opening book " + path + " has a different format");
+    }
+}
+
+OpeningBook::~OpeningBook() {
+    munmap(const_cast<uint8_t*>(data), file_size);
+}
+
+size_t OpeningBook::size() const {
+    return static_cast<size_t>(header->n_entries);
+}
+
+bool OpeningBook::lookup(const Board &board, std::vector<double> &probs) const {
+    if (board.get_n() != n || board.get_n_in_row() != n_in_row) {
+        return false;
+    }
+    uint64_t key;
+    int transform;
+    std::tie(key, transform) = Symmetry::get_canonical_hash(board);
+
+    // binary search over the sorted keys
+    const uint8_t *entries = data + sizeof(Header);
+    size_t lo = 0, hi = size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint64_t mid_key;
+        std::memcpy(&mid_key, entries + mid * header->entry_size, sizeof(mid_key));
+        if (mid_key < key) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    const uint8_t *entry = entries + lo * header->entry_size;
+    uint64_t found;
+    if (lo == size() || (std::memcpy(&found, entry, sizeof(found)), found != key)) {
+        return false;
+    }
+
+    // the policy is stored in the canonical orientation
+    int size = n * n;
+    const std::vector<int> &table = Symmetry::get_table(n, transform);
+    probs.assign(size, 0.0);
+    for (int pos = 0; pos < size; ++pos) {
+        uint16_t q;
+        std::memcpy(&q, entry + 8 + 2 * table[pos], sizeof(q));
+        probs[pos] = q / 65535.0;
+    }
+    return true;
+}
+
+/*
+    breadth first from the empty board, symmetric positions are searched once
+    the book is written to a temporary file and renamed, so readers of an old book keep a valid mapping
+*/
+size_t OpeningBook::build(std::string path, AlphaZero &player, int n, int n_in_row, int max_plies, double min_prob) {
+    int size = n * n;
+    uint32_t entry_size = (8 + 2 * size + 7) / 8 * 8;
+    std::map<uint64_t, std::vector<uint16_t>> entries; // key -> canonical policy, sorted for the file
+
+    std::queue<std::pair<Board, int>> frontier;  // board, plies
+    frontier.emplace(Board(n, n_in_row), 0);
+    entries.emplace(Symmetry::get_canonical_hash(frontier.front().first).first, std::vector<uint16_t>());
+    while (!frontier.empty()) {
+        Board board = frontier.front().first;
+        int plies = frontier.front().second;
+        frontier.pop();
+
+        player.update_with_move(-1);
+        std::vector<double> probs = player.get_action_probs(board, 1.0);
+        uint64_t key;
+        int transform;
+        std::tie(key, transform) = Symmetry::get_canonical_hash(board);
+        const std::vector<int> &table = Symmetry::get_table(n, transform);
+        std::vector<uint16_t> &policy = entries[key];
+        policy.assign(size, 0);
+        for (int pos = 0; pos < size; ++pos) {
+            policy[table[pos]] = static_cast<uint16_t>(std::lround(std::min(std::max(probs[pos], 0.0), 1.0) * 65535.0));
+        }
+
+        if (plies + 1 >= max_plies) {
+            continue;
+        }
+        for (int action = 0; action < size; ++action) {
+            if (probs[action] < min_prob) {
+                continue;
+            }
+            Board next = board;
+            next.exec_move(action);
+            if (next.get_result().first) {
+                continue;
+            }
+            // reserve the key, so a symmetric position is not queued twice
+            if (entries.emplace(Symmetry::get_canonical_hash(next).first, std::vector<uint16_t>()).second) {
+                frontier.emplace(next, plies + 1);
+            }
+        }
+    }
+    player.update_with_move(-1);
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("cannot write opening book " + path);
+        }
+        Header header{};
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = version;
+        header.n = n;
+        header.n_in_row = n_in_row;
+        header.entry_size = entry_size;
+        header.n_entries = entries.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        std::vector<uint8_t> entry(entry_size);
+        for (const auto &item : entries) {
+            std::fill(entry.begin(), entry.end(), 0);
+            std::memcpy(entry.data(), &item.first, sizeof(item.first));
+            std::memcpy(entry.data() + 8, item.second.data(), 2 * size);
+            out.write(reinterpret_cast<const char*>(entry.data()), entry_size);
+        }
+        if (!out) {
+            throw std::runtime_error("cannot write opening book " + path);
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("cannot write opening book " + path);
+    }
+    return entries.size();
+}
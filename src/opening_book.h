@@ -0,0 +1,57 @@
+#pragma once
+#include "board.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class AlphaZero;
+
+/*
+    root visit distributions of deep searches on early positions, in a read-only memory-mapped file
+    positions are keyed by their canonical hash, so a position and its symmetries share one entry,
+    and policies are stored in the canonical orientation
+    lookups only read the mapping, so one book can be shared by any number of threads
+
+    file layout: Header, then n_entries entries sorted by key
+        uint64_t key                      Symmetry::get_canonical_hash
+        uint16_t policy[n * n]            visit shares scaled by 65535
+*/
+class OpeningBook {
+public:
+    explicit OpeningBook(std::string path);
+    ~OpeningBook();
+
+    OpeningBook(const OpeningBook &) = delete;
+    OpeningBook &operator=(const OpeningBook &) = delete;
+
+    // visit distribution of the board over all n * n actions, false if it is not in the book
+    bool lookup(const Board &board, std::vector<double> &probs) const;
+
+    size_t size() const;
+    int get_n() const { return n; }
+    int get_n_in_row() const { return n_in_row; }
+
+    /*
+        search every position within max_plies plies of the empty board with player and write the book to path
+        only moves with at least min_prob of the root visits are followed, return the number of positions
+    */
+    static size_t build(std::string path, AlphaZero &player, int n, int n_in_row, int max_plies, double min_prob = 0.05);
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t n;
+        uint32_t n_in_row;
+        uint32_t entry_size;
+        uint64_t n_entries;
+    };
+
+    static constexpr char magic[9] = "AZBOOK01";
+    static constexpr uint32_t version = 1;
+
+    const uint8_t *data = nullptr;
+    const Header *header = nullptr;
+    size_t file_size = 0;
+    int n = 0;
+    int n_in_row = 0;
+};
@@ -0,0 +1,76 @@
+#include "reclaimer.h"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace {
+
+class Worker {
+public:
+    Worker() : thread([this]() { run(); }) { }
+
+    ~Worker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+    void push(std::shared_ptr<void> garbage) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(garbage));
+        }
+        cv.notify_all();
+    }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return queue.empty() && !busy; });
+    }
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [this]() { return stop || !queue.empty(); });
+            if (queue.empty()) { // stop, and everything is freed
+                return;
+            }
+            std::shared_ptr<void> garbage = std::move(queue.front());
+            queue.pop_front();
+            busy = true;
+            lock.unlock();
+            garbage.reset();
+            lock.lock();
+            busy = false;
+            cv.notify_all();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<void>> queue;
+    bool busy = false;
+    bool stop = false;
+    std::thread thread;  // last, it starts after the members it uses
+};
+
+Worker &get_worker() {
+    static Worker worker;
+    return worker;
+}
+
+}
+
+void Reclaimer::defer(std::shared_ptr<void> garbage) {
+    if (garbage) {
+        get_worker().push(std::move(garbage));
+    }
+}
+
+void Reclaimer::wait_idle() {
+    get_worker().wait_idle();
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <memory>
+
+/*
+    frees large objects on one background thread shared by the whole process
+    a search tree hands over its old arena after compaction, so the free of many
+    chunks is not paid on the move-latency path, nor once per concurrent game
+*/
+class Reclaimer {
+public:
+    // the last reference to garbage is dropped on the background thread
+    static void defer(std::shared_ptr<void> garbage);
+    // block until everything deferred so far is freed
+    static void wait_idle();
+};
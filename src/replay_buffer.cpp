@@ -0,0 +1,167 @@
+#include "replay_buffer.h"
+#include "symmetry.h"
+#include "bitboard.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+constexpr char ReplayBuffer::magic[9];
+constexpr uint32_t ReplayBuffer::version;
+
+ReplayBuffer::ReplayBuffer(std::string path, int n, size_t capacity) :
+    path(path), n(n), capacity(capacity), plane_bytes((n * n + 7) / 8), rng(std::random_device()()) {
+    if (n < 1 || n > BitBoard::max_n) {
+        throw std::invalid_argument("board size must be in [1, " + std::to_string(BitBoard::max_n) + "]");
+    }
+    if (capacity == 0) {
+        throw std::invalid_argument("replay buffer capacity must be positive");
+    }
+    record_size = (2 * plane_bytes + 4 + 2 * n * n + 7) / 8 * 8;
+    file_size = sizeof(Header) + capacity * record_size;
+
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open replay buffer " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot stat replay buffer " + path);
+    }
+    bool created = st.st_size == 0;
+    if (created && ftruncate(fd, file_size) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot resize replay buffer " + path);
+    }
+    if (!created && static_cast<size_t>(st.st_size) != file_size) {
+        close(fd);
+        throw std::runtime_error("replay buffer " + path + " has a different board size or capacity");
+    }
+
+    void *addr = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("cannot map replay buffer " + path);
+    }
+    data = static_cast<uint8_t*>(addr);
+    header = reinterpret_cast<Header*>(data);
+
+    if (created) {
+        std::memcpy(header->magic, magic, sizeof(header->magic));
+        header->version = version;
+        header->n = n;
+        header->capacity = capacity;
+        header->record_size = record_size;
+        header->head = 0;
+        header->count = 0;
+    }
+    else if (std::memcmp(header->magic, magic, sizeof(header->magic)) != 0 || header->version != version
+        || header->n != static_cast<uint32_t>(n) || header->capacity != capacity || header->record_size != record_size) {
+        munmap(data, file_size);
+        close(fd);
+        throw std::runtime_error("replay buffer " + path + " has a different format");
+    }
+}
+
+ReplayBuffer::~ReplayBuffer() {
+    flush();
+    munmap(data, file_size);
+    close(fd);
+}
+
+size_t ReplayBuffer::size() const {
+    return static_cast<size_t>(header->count);
+}
+
+void ReplayBuffer::flush() {
+    msync(data, file_size, MS_SYNC);
+}
+
+void ReplayBuffer::append(const std::vector<float> &states, const std::vector<float> &probs, const std::vector<float> &values) {
+    size_t board_size = n * n;
+    size_t k = values.size();
+    if (states.size() != k * 4 * board_size || probs.size() != k * board_size) {
+        throw std::invalid_argument("states, probs and values hold a different number of examples");
+    }
+    for (size_t i = 0; i < k; ++i) {
+        write_record(record(header->head), &states[i * 4 * board_size], &probs[i * board_size], values[i]);
+        // the record is complete before the header points past it
+        header->head = (header->head + 1) % capacity;
+        header->count = std::min<uint64_t>(header->count + 1, capacity);
+    }
+}
+
+void ReplayBuffer::sample(size_t batch_size, bool augment) {
+    size_t board_size = n * n;
+    batch_states.resize(batch_size * 4 * board_size);
+    batch_probs.resize(batch_size * board_size);
+    batch_values.resize(batch_size);
+    if (size() == 0) {
+        throw std::runtime_error("sample from an empty replay buffer");
+    }
+    std::uniform_int_distribution<size_t> index(0, size() - 1);
+    std::uniform_int_distribution<int> symmetry(0, Symmetry::n_symmetries - 1);
+    for (size_t i = 0; i < batch_size; ++i) {
+        int transform = augment ? symmetry(rng) : 0;
+        read_record(record(index(rng)), transform, &batch_states[i * 4 * board_size],
+            &batch_probs[i * board_size], batch_values[i]);
+    }
+}
+
+void ReplayBuffer::write_record(uint8_t *dst, const float *state, const float *prob, float value) const {
+    int board_size = n * n;
+    std::memset(dst, 0, record_size);
+    int16_t last_move = -1;
+    for (int pos = 0; pos < board_size; ++pos) {
+        if (state[pos] > 0.5f) {
+            dst[pos >> 3] |= 1 << (pos & 7);
+        }
+        if (state[board_size + pos] > 0.5f) {
+            dst[plane_bytes + (pos >> 3)] |= 1 << (pos & 7);
+        }
+        if (state[2 * board_size + pos] > 0.5f) {
+            last_move = static_cast<int16_t>(pos);
+        }
+    }
+    uint8_t *p = dst + 2 * plane_bytes;
+    std::memcpy(p, &last_move, sizeof(last_move));
+    p[2] = state[3 * board_size] > 0.5f;
+    p[3] = static_cast<uint8_t>(static_cast<int8_t>(std::lround(value)));
+    p += 4;
+    for (int pos = 0; pos < board_size; ++pos) {
+        uint16_t q = static_cast<uint16_t>(std::lround(std::min(std::max(prob[pos], 0.0f), 1.0f) * 65535.0f));
+        std::memcpy(p + 2 * pos, &q, sizeof(q));
+    }
+}
+
+void ReplayBuffer::read_record(const uint8_t *src, int transform, float *state, float *prob, float &value) const {
+    int board_size = n * n;
+    const std::vector<int> &table = Symmetry::get_table(n, transform);
+    const uint8_t *p = src + 2 * plane_bytes;
+    int16_t last_move;
+    std::memcpy(&last_move, p, sizeof(last_move));
+
+    std::fill(state, state + 3 * board_size, 0.0f);
+    std::fill(state + 3 * board_size, state + 4 * board_size, p[2] ? 1.0f : 0.0f);
+    for (int pos = 0; pos < board_size; ++pos) {
+        int to = table[pos];
+        if ((src[pos >> 3] >> (pos & 7)) & 1) {
+            state[to] = 1.0f;
+        }
+        if ((src[plane_bytes + (pos >> 3)] >> (pos & 7)) & 1) {
+            state[board_size + to] = 1.0f;
+        }
+        uint16_t q;
+        std::memcpy(&q, p + 4 + 2 * pos, sizeof(q));
+        prob[to] = q / 65535.0f;
+    }
+    if (last_move != -1) {
+        state[2 * board_size + table[last_move]] = 1.0f;
+    }
+    value = static_cast<int8_t>(p[3]);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <random>
+#include <cstdint>
+
+/*
+    replay buffer of training positions in a memory-mapped file of fixed-size records
+    the file keeps the last capacity positions, new positions overwrite the oldest ones,
+    so only the positions of new games are written each iteration
+    positions are stored once, symmetries are applied when a batch is sampled
+
+    file layout: Header, then capacity records of
+        uint8_t  stones[2][plane_bytes]   bit-packed stones of the first and second player
+        int16_t  last_move                -1 before the first move
+        uint8_t  is_first                 the first player is to move
+        int8_t   value                    game result from the view of the player to move
+        uint16_t policy[n * n]            probabilities scaled by 65535
+*/
+class ReplayBuffer {
+public:
+    // open the buffer at path, or create it if the file does not exist
+    ReplayBuffer(std::string path, int n, size_t capacity);
+    ~ReplayBuffer();
+
+    ReplayBuffer(const ReplayBuffer &) = delete;
+    ReplayBuffer &operator=(const ReplayBuffer &) = delete;
+
+    /*
+        append examples in the layout of the network input
+        states [k, 4, n, n], probs [k, n * n], values [k]
+    */
+    void append(const std::vector<float> &states, const std::vector<float> &probs, const std::vector<float> &values);
+
+    /*
+        draw batch_size positions uniformly with replacement, under a random symmetry if augment is set
+        the batch is read with get_batch_states, get_batch_probs and get_batch_values
+    */
+    void sample(size_t batch_size, bool augment = true);
+    const std::vector<float> &get_batch_states() const { return batch_states; }   // [batch_size, 4, n, n]
+    const std::vector<float> &get_batch_probs() const { return batch_probs; }     // [batch_size, n * n]
+    const std::vector<float> &get_batch_values() const { return batch_values; }   // [batch_size]
+
+    // write dirty pages back to the file
+    void flush();
+
+    size_t size() const;
+    size_t get_capacity() const { return capacity; }
+    int get_n() const { return n; }
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t n;
+        uint64_t capacity;
+        uint64_t record_size;
+        uint64_t head;      // next record to write
+        uint64_t count;     // valid records
+    };
+
+    static constexpr char magic[9] = "AZREPLAY";
+    static constexpr uint32_t version = 1;
+
+    uint8_t *record(size_t i) const { return data + sizeof(Header) + i * record_size; }
+    void write_record(uint8_t *dst, const float *state, const float *prob, float value) const;
+    void read_record(const uint8_t *src, int transform, float *state, float *prob, float &value) const;
+
+    std::string path;
+    int n;
+    size_t capacity;
+    size_t plane_bytes;
+    size_t record_size;
+    int fd = -1;
+    size_t file_size = 0;
+    uint8_t *data = nullptr;
+    Header *header = nullptr;
+    std::mt19937 rng;
+    std::vector<float> batch_states;
+    std::vector<float> batch_probs;
+    std::vector<float> batch_values;
+};
@@ -0,0 +1,129 @@
+#include "rollout.h"
+#include "board_size.h"
+#include <random>
+#include <utility>
+#include <cstdint>
+
+/*
+    a window of k cells along a line wins if it holds k - 1 stones and one empty cell
+    for each position j of the empty cell in the window, the other k - 1 cells are
+    tested with the and of shifted copies, shared through prefix and suffix products
+*/
+BitBoard Rollout::get_winning_cells(const BitBoard &stones, const BitBoard &empty, int n, int k) {
+    return dispatch_size(n, k, [&](auto size) { return get_winning_cells(stones, empty, size); });
+}
+
+template <class S>
+BitBoard Rollout::get_winning_cells(const BitBoard &stones, const BitBoard &empty, S size) {
+    const int k = size.k;
+    const int strides[4] = {1, size.n + 1, size.n + 2, size.n}; // row, column, diagonal, anti-diagonal
+    BitBoard res;
+    for (int d : strides) {
+        BitBoard shifted[BitBoard::max_n];
+        for (int i = 0; i < k; ++i) {
+            shifted[i] = stones >> (i * d);
+        }
+        BitBoard suffix[BitBoard::max_n]; // suffix[j]: and of shifted[j + 1 .. k - 1]
+        for (int j = k - 2; j >= 0; --j) {
+            suffix[j] = j == k - 2 ? shifted[k - 1] : suffix[j + 1] & shifted[j + 1];
+        }
+        BitBoard prefix;                  // and of shifted[0 .. j - 1]
+        for (int j = 0; j < k; ++j) {
+            BitBoard window = empty >> (j * d);
+            if (j > 0) {
+                window = window & prefix;
+            }
+            if (j < k - 1) {
+                window = window & suffix[j];
+            }
+            res = res | (window << (j * d));
+            prefix = j == 0 ? shifted[0] : prefix & shifted[j];
+        }
+    }
+    return res;
+}
+
+/*
+    after a stone at bit, the new winning cells lie on its four lines
+    all cells between such a cell and bit are stones, so it is the first
+    non-stone cell on either side of the run through bit
+*/
+template <class S>
+void Rollout::add_winning_cells(const BitBoard &stones, const BitBoard &empty, S size, int bit, BitBoard &wins) {
+    const int k = size.k;
+    const int strides[4] = {1, size.n + 1, size.n + 2, size.n};
+    auto is_stone = [&](int i) { return i >= 0 && i < BitBoard::n_bits && stones.test(i); };
+    auto is_empty = [&](int i) { return i >= 0 && i < BitBoard::n_bits && empty.test(i); };
+    for (int d : strides) {
+        int hi = bit, lo = bit;
+        while (is_stone(hi + d)) hi += d;
+        while (is_stone(lo - d)) lo -= d;
+        int run = (hi - lo) / d + 1;
+        if (is_empty(hi + d)) {
+            int len = run + 1;
+            for (int i = hi + 2 * d; len < k && is_stone(i); i += d) ++len;
+            if (len >= k) wins.set(hi + d);
+        }
+        if (is_empty(lo - d)) {
+            int len = run + 1;
+            for (int i = lo - 2 * d; len < k && is_stone(i); i -= d) ++len;
+            if (len >= k) wins.set(lo - d);
+        }
+    }
+}
+
+double Rollout::simulate(const Board &board) {
+    return dispatch_size(board.get_n(), board.get_n_in_row(), [&](auto size) { return simulate(board, size); });
+}
+
+template <class S>
+double Rollout::simulate(const Board &board, S size) {
+    thread_local std::mt19937 rng(std::random_device{}());
+    BitBoard stones[2] = {board.get_stones(board.get_cur_player()), board.get_stones(-board.get_cur_player())};
+    BitBoard empty = board.get_empty();
+
+    // empty cells as a list with a reverse index, so both random and given cells are removed in O(1)
+    int16_t cells[BitBoard::n_bits];
+    int16_t index[BitBoard::n_bits];
+    int n_empty = 0;
+    empty.for_each([&](int bit) {
+        index[bit] = static_cast<int16_t>(n_empty);
+        cells[n_empty++] = static_cast<int16_t>(bit);
+    });
+
+    // winning cells of the player to move (0) and of the other one (1), relative to the start
+    BitBoard wins[2] = {get_winning_cells(stones[0], empty, size), get_winning_cells(stones[1], empty, size)};
+    int me = 0;
+    while (true) {
+        if (wins[me].any()) { // take the win
+            return me == 0 ? 1 : -1;
+        }
+        int other = 1 - me;
+        int bit = wins[other].lowest();
+        if (bit != -1) {
+            BitBoard rest = wins[other];
+            rest.reset(bit);
+            if (rest.any()) { // two winning cells cannot both be blocked
+                return other == 0 ? 1 : -1;
+            }
+        }
+        else if (n_empty == 0) {
+            return 0;
+        }
+        else {
+            bit = cells[rng() % n_empty];
+        }
+
+        // remove bit from the list by moving the last cell into its place
+        int i = index[bit];
+        cells[i] = cells[--n_empty];
+        index[cells[i]] = static_cast<int16_t>(i);
+        stones[me].set(bit);
+        empty.reset(bit);
+
+        // the opponent keeps its winning cells except the one just filled
+        wins[other].reset(bit);
+        add_winning_cells(stones[me], empty, size, bit, wins[me]);
+        me = other;
+    }
+}
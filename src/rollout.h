@@ -0,0 +1,27 @@
+#pragma once
+#include "board.h"
+#include "bitboard.h"
+
+/*
+    fast random playouts for the pure mcts baseline
+    moves are drawn from an incremental list of empty cells with a thread-local rng,
+    a playout takes an immediate win, blocks the opponent's only winning cell,
+    and stops early once the result is decided
+*/
+class Rollout {
+public:
+    // play the board out, return 1/0/-1 from the view of the player to move
+    static double simulate(const Board &board);
+
+    // empty cells that complete k in a row for stones, in the padded layout of a board of size n
+    static BitBoard get_winning_cells(const BitBoard &stones, const BitBoard &empty, int n, int k);
+private:
+    // the same for a size policy, see board_size.h
+    template <class S>
+    static double simulate(const Board &board, S size);
+    template <class S>
+    static BitBoard get_winning_cells(const BitBoard &stones, const BitBoard &empty, S size);
+    // add the winning cells created by a stone just placed at bit
+    template <class S>
+    static void add_winning_cells(const BitBoard &stones, const BitBoard &empty, S size, int bit, BitBoard &wins);
+};
@@ -0,0 +1,189 @@
+#include "self_play.h"
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+SelfPlayEngine::SelfPlayEngine(NeuralNetwork *neural_network, int n, int n_in_row, size_t n_parallel_games,
+    size_t thread_num, int n_playout, double c_puct, double c_virtual_loss) :
+    neural_network(neural_network), n(n), n_in_row(n_in_row), n_parallel_games(std::max<size_t>(n_parallel_games, 1)),
+    thread_num(thread_num), n_playout(n_playout), c_puct(c_puct), c_virtual_loss(c_virtual_loss),
+    seed(std::random_device()()) { }
+
+void SelfPlayEngine::set_dirichlet_noise(double alpha, double epsilon) {
+    dirichlet_alpha = alpha;
+    dirichlet_epsilon = epsilon;
+}
+
+void SelfPlayEngine::set_playout_cap(double full_prob, int fast_playout) {
+    if (!(full_prob > 0 && full_prob <= 1)) {
+        throw std::invalid_argument("full_prob must be in (0, 1]");
+    }
+    if (fast_playout < 1 || fast_playout > n_playout) {
+        throw std::invalid_argument("fast_playout must be in [1, n_playout]");
+    }
+    this->full_prob = full_prob;
+    this->fast_playout = fast_playout;
+}
+
+void SelfPlayEngine::clear() {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    states.clear();
+    probs.clear();
+    values.clear();
+    game_lengths.clear();
+}
+
+void SelfPlayEngine::play(int n_games, bool show) {
+    n_started = 0;
+    size_t n_threads = std::min<size_t>(n_parallel_games, std::max(n_games, 0));
+    unsigned base_seed = seed;
+    seed += static_cast<unsigned>(n_threads); // later calls do not replay the same games
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < n_threads; ++i) {
+        threads.emplace_back([this, i, base_seed, n_games, show]() {
+            AlphaZero player(neural_network, thread_num, n_playout, c_puct, c_virtual_loss);
+            player.set_transposition_table_size(transposition_table_mb);
+            player.set_node_budget(node_budget);
+            player.set_opening_book(opening_book);
+            player.set_early_stop(early_stop);
+            std::mt19937 rng(base_seed + static_cast<unsigned>(i));
+            play_games(player, rng, n_games, show);
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+/*
+    helper function
+    take games from the shared counter until all n_games have been started
+*/
+void SelfPlayEngine::play_games(AlphaZero &player, std::mt19937 &rng, int n_games, bool show) {
+    while (true) {
+        int k = n_started++;
+        if (k >= n_games) {
+            return;
+        }
+        Game game;
+        play_game(player, rng, show && k == 0, game);
+    }
+}
+
+void SelfPlayEngine::play_game(AlphaZero &player, std::mt19937 &rng, bool show, Game &game) {
+    if (show) {
+        std::cout << "display of a self play round begins" << std::endl << std::endl;
+    }
+
+    int board_size = n * n;
+    Board board(n, n_in_row);
+    player.update_with_move(-1); // start from an empty tree
+
+    for (int step = 1; ; ++step) {
+        // the draw is skipped without randomization, so the games stay the same for a seed
+        bool full_search = full_prob >= 1.0 || std::bernoulli_distribution(full_prob)(rng);
+        player.set_n_playout(full_search ? n_playout : fast_playout);
+
+        // have exploration in the first num_explore steps
+        std::vector<double> prob;
+        if (step <= num_explore) {
+            prob = player.get_action_probs(board, temp);
+            if (full_search) { // fast moves are not trained on, so they are played without noise
+                add_noise(board, rng, prob);
+            }
+        }
+        else {
+            prob = player.get_action_probs(board, 0);
+        }
+
+        // get action according to prob
+        std::discrete_distribution<int> distribution(prob.cbegin(), prob.cend());
+        int action = distribution(rng);
+
+        // the visits of a fast search are too few for a policy target
+        if (full_search) {
+            size_t offset = game.states.size();
+            game.states.resize(offset + 4 * board_size);
+            board.encode(&game.states[offset]);
+            game.probs.insert(game.probs.end(), prob.cbegin(), prob.cend());
+            game.players.push_back(board.get_cur_player());
+        }
+
+        board.exec_move(action);
+        if (show) {
+            display(board, prob, action);
+        }
+        player.update_with_move(action);
+
+        auto result = board.get_result();
+        if (result.first) {
+            if (show) {
+                std::cout << "display of a self play round finished" << std::endl << std::endl;
+            }
+            std::lock_guard<std::mutex> lock(output_mutex);
+            states.insert(states.end(), game.states.cbegin(), game.states.cend());
+            probs.insert(probs.end(), game.probs.cbegin(), game.probs.cend());
+            for (int cur_player : game.players) {
+                values.push_back(static_cast<float>(cur_player * result.second));
+            }
+            game_lengths.push_back(step);
+            return;
+        }
+    }
+}
+
+/*
+    helper function
+    prob := (1 - epsilon) * prob + epsilon * Dir(alpha) over the legal moves
+*/
+void SelfPlayEngine::add_noise(const Board &board, std::mt19937 &rng, std::vector<double> &prob) const {
+    auto legal_moves = board.get_moves();
+    std::gamma_distribution<double> gamma(dirichlet_alpha, 1.0);
+    std::vector<double> noise(legal_moves.size());
+    for (double &x : noise) {
+        x = gamma(rng);
+    }
+    double noise_sum = std::accumulate(noise.cbegin(), noise.cend(), 0.0);
+
+    for (double &x : prob) {
+        x *= 1 - dirichlet_epsilon;
+    }
+    if (noise_sum > 0) {
+        for (size_t i = 0; i < legal_moves.size(); ++i) {
+            prob[legal_moves[i]] += dirichlet_epsilon * noise[i] / noise_sum;
+        }
+    }
+    // normalization
+    double sum = std::accumulate(prob.cbegin(), prob.cend(), 0.0);
+    std::for_each(prob.begin(), prob.end(),
+        [sum](double &x) { x /= sum; });
+}
+
+/*
+    helper function
+    display the action probability and the board
+*/
+void SelfPlayEngine::display(const Board &board, const std::vector<double> &prob, int action) const {
+    auto flags = std::cout.flags();
+    auto precision = std::cout.precision();
+    std::cout << std::fixed << std::setprecision(3);
+    for (int i = 0; i < n * n; ++i) {
+        if (i % n == 0) {
+            std::cout << std::endl;
+        }
+        if (i == action) {
+            std::cout << "\033[31;1m" << prob[i] << "\033[0m ";
+        }
+        else {
+            std::cout << prob[i] << ' ';
+        }
+    }
+    std::cout << std::endl << std::endl;
+    std::cout.flags(flags);
+    std::cout.precision(precision);
+    board.display();
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "board.h"
+#include "mcts.h"
+#include "neural_network.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <random>
+
+/*
+    plays many self-play games at once against one shared neural network
+    every game runs on its own thread with its own search tree, so the batches of the
+    network are filled by the playouts of all games together
+    examples are collected in flat buffers and handed to python in bulk
+*/
+class SelfPlayEngine {
+public:
+    SelfPlayEngine(NeuralNetwork *neural_network, int n, int n_in_row, size_t n_parallel_games,
+        size_t thread_num, int n_playout, double c_puct, double c_virtual_loss);
+
+    // temperature of the move distribution during the first num_explore moves, greedy afterwards
+    void set_temp(double temp) { this->temp = temp; }
+    void set_num_explore(int num_explore) { this->num_explore = num_explore; }
+    // mix epsilon * Dir(alpha) over the legal moves into the move distribution while exploring
+    void set_dirichlet_noise(double alpha, double epsilon = 0.25);
+    void set_transposition_table_size(size_t size_mb) { transposition_table_mb = size_mb; }
+    // nodes per search tree, 0 for no limit, see MCTS::set_node_budget
+    void set_node_budget(size_t max_nodes) { node_budget = max_nodes; }
+    // see MCTS::set_opening_book
+    void set_opening_book(const OpeningBook *opening_book) { this->opening_book = opening_book; }
+    // see MCTS::set_early_stop
+    void set_early_stop(bool early_stop) { this->early_stop = early_stop; }
+    /*
+        playout cap randomization: a move is searched with the full n_playout with probability full_prob,
+        otherwise with fast_playout, and only positions of full searches are kept as examples
+        and get dirichlet noise, full_prob in (0, 1] with 1 searching every move in full,
+        fast_playout in [1, n_playout]
+    */
+    void set_playout_cap(double full_prob, int fast_playout);
+    void set_seed(unsigned seed) { this->seed = seed; }
+
+    /*
+        play n_games games, n_parallel_games at a time, and append their examples
+        the first game is displayed move by move if show is set
+    */
+    void play(int n_games, bool show = false);
+
+    // examples in the order their games finished, one per full search
+    size_t get_n_examples() const { return values.size(); }
+    const std::vector<float> &get_states() const { return states; }   // [n_examples, 4, n, n]
+    const std::vector<float> &get_probs() const { return probs; }     // [n_examples, n * n]
+    const std::vector<float> &get_values() const { return values; }   // [n_examples], from the view of the player to move
+    const std::vector<int> &get_game_lengths() const { return game_lengths; }
+    void clear();
+private:
+    struct Game {
+        std::vector<float> states;
+        std::vector<float> probs;
+        std::vector<int> players;
+    };
+
+    void play_games(AlphaZero &player, std::mt19937 &rng, int n_games, bool show);
+    void play_game(AlphaZero &player, std::mt19937 &rng, bool show, Game &game);
+    void add_noise(const Board &board, std::mt19937 &rng, std::vector<double> &prob) const;
+    void display(const Board &board, const std::vector<double> &prob, int action) const;
+
+    NeuralNetwork *neural_network;
+    int n;
+    int n_in_row;
+    size_t n_parallel_games;
+    size_t thread_num;
+    int n_playout;
+    double c_puct;
+    double c_virtual_loss;
+    size_t transposition_table_mb = 0;
+    size_t node_budget = 0;
+    const OpeningBook *opening_book = nullptr;
+    bool early_stop = true;
+    double full_prob = 1.0;
+    int fast_playout = 0;
+    double temp = 1.0;
+    int num_explore = 0;
+    double dirichlet_alpha = 0.3;
+    double dirichlet_epsilon = 0.25;
+    unsigned seed;
+
+    std::atomic<int> n_started{0};   // games handed out in the current play()
+    std::mutex output_mutex;         // guards the buffers below
+    std::vector<float> states;
+    std::vector<float> probs;
+    std::vector<float> values;
+    std::vector<int> game_lengths;
+};
@@ -0,0 +1,122 @@
+#include "symmetry.h"
+#include <array>
+#include <algorithm>
+
+constexpr int Symmetry::n_symmetries;
+
+const std::vector<int> &Symmetry::get_table(int n, int t) {
+    using tables_type = std::array<std::array<std::vector<int>, n_symmetries>, BitBoard::max_n + 1>;
+    static const tables_type tables = []() {
+        tables_type res;
+        for (int k = 1; k <= BitBoard::max_n; ++k) {
+            for (int t = 0; t < n_symmetries; ++t) {
+                res[k][t].resize(k * k);
+                for (int x = 0; x < k; ++x) {
+                    for (int y = 0; y < k; ++y) {
+                        int tx = x, ty = y;
+                        for (int r = 0; r < t / 2; ++r) { // rot90: (x, y) -> (k - 1 - y, x)
+                            int tmp = tx;
+                            tx = k - 1 - ty;
+                            ty = tmp;
+                        }
+                        if (t % 2 == 1) { // fliplr: (x, y) -> (x, k - 1 - y)
+                            ty = k - 1 - ty;
+                        }
+                        res[k][t][x * k + y] = tx * k + ty;
+                    }
+                }
+            }
+        }
+        return res;
+    }();
+    return tables[n][t];
+}
+
+std::pair<uint64_t, int> Symmetry::get_canonical_hash(const Board &board) {
+    int n = board.get_n();
+    const std::vector<int> *tables[n_symmetries];
+    uint64_t hashes[n_symmetries];
+    for (int t = 0; t < n_symmetries; ++t) {
+        tables[t] = &get_table(n, t);
+        hashes[t] = board.get_move_cnt() % 2 == 0 ? 0 : Board::get_zobrist_side_key();
+    }
+    for (int player : {1, -1}) {
+        board.get_stones(player).for_each([&](int bit) {
+            int pos = board.to_pos(bit);
+            for (int t = 0; t < n_symmetries; ++t) {
+                hashes[t] ^= Board::get_zobrist_key(board.to_bit((*tables[t])[pos]), player);
+            }
+        });
+    }
+    int last_move = board.get_last_move();
+    int best = 0;
+    for (int t = 0; t < n_symmetries; ++t) {
+        if (last_move != -1) { // splitmix64 finalizer of the transformed last move
+            uint64_t z = (*tables[t])[last_move] + 0x9e3779b97f4a7c15ull;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            hashes[t] ^= z ^ (z >> 31);
+        }
+        if (hashes[t] < hashes[best]) {
+            best = t;
+        }
+    }
+    return std::make_pair(hashes[best], best);
+}
+
+void Symmetry::encode(const Board &board, int t, float *dst) {
+    if (t == 0) {
+        board.encode(dst);
+        return;
+    }
+    int n = board.get_n(), size = n * n;
+    const std::vector<int> &table = get_table(n, t);
+    std::fill(dst, dst + 3 * size, 0.0f);
+    std::fill(dst + 3 * size, dst + 4 * size, board.get_move_cnt() % 2 == 0 ? 1.0f : 0.0f);
+    board.get_stones(1).for_each([&](int bit) {
+        dst[table[board.to_pos(bit)]] = 1.0f;
+    });
+    board.get_stones(-1).for_each([&](int bit) {
+        dst[size + table[board.to_pos(bit)]] = 1.0f;
+    });
+    if (board.get_last_move() != -1) {
+        dst[2 * size + table[board.get_last_move()]] = 1.0f;
+    }
+}
+
+void Symmetry::transform(int n, int t, const float *src, int n_planes, float *dst) {
+    int size = n * n;
+    const std::vector<int> &table = get_table(n, t);
+    for (int plane = 0; plane < n_planes; ++plane) {
+        for (int pos = 0; pos < size; ++pos) {
+            dst[table[pos]] = src[pos];
+        }
+        src += size;
+        dst += size;
+    }
+}
+
+std::vector<float> Symmetry::augment(int n, int n_planes, const std::vector<float> &data) {
+    int size = n * n;
+    size_t example_size = static_cast<size_t>(n_planes) * size;
+    size_t k = data.size() / example_size;
+    const std::vector<int> *tables[n_symmetries];
+    for (int t = 0; t < n_symmetries; ++t) {
+        tables[t] = &get_table(n, t);
+    }
+    std::vector<float> res(k * n_symmetries * example_size);
+    // every source cell is read once and scattered into all symmetries
+    for (size_t i = 0; i < k; ++i) {
+        const float *src = &data[i * example_size];
+        float *dst = &res[i * n_symmetries * example_size];
+        for (int plane = 0; plane < n_planes; ++plane) {
+            for (int pos = 0; pos < size; ++pos) {
+                float x = src[plane * size + pos];
+                for (int t = 0; t < n_symmetries; ++t) {
+                    dst[t * example_size + plane * size + (*tables[t])[pos]] = x;
+                }
+            }
+        }
+    }
+    return res;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "board.h"
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+/*
+    the 8 symmetries of a square board, with precomputed permutation tables per board size
+    transform 2 * i rotates the board i times by 90 degrees counterclockwise (np.rot90),
+    transform 2 * i + 1 additionally flips it left-right (np.fliplr)
+*/
+class Symmetry {
+public:
+    static constexpr int n_symmetries = 8;
+
+    // table[pos] is where the cell at pos moves under transform t
+    static const std::vector<int> &get_table(int n, int t);
+
+    /*
+        hash of the network input (stones, last move, and move parity) minimised over
+        all symmetries, together with the transform that maps the board to that orientation
+    */
+    static std::pair<uint64_t, int> get_canonical_hash(const Board &board);
+
+    // write the 4 * n * n network input planes of the board under transform t
+    static void encode(const Board &board, int t, float *dst);
+
+    // the transform that undoes t
+    static int inverse(int t) { return t % 2 == 1 ? t : (n_symmetries - t) % n_symmetries; }
+
+    // dst = src under transform t, for n_planes consecutive n * n planes
+    static void transform(int n, int t, const float *src, int n_planes, float *dst);
+
+    /*
+        all symmetries of k examples in one pass, each example is n_planes planes of n * n
+        ([k, 4, n, n] states or [k, n * n] policies), the result holds the
+        n_symmetries transforms of each example next to each other
+    */
+    static std::vector<float> augment(int n, int n_planes, const std::vector<float> &data);
+};
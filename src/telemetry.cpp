@@ -0,0 +1,115 @@
+#include "telemetry.h"
+#include <fstream>
+#include <algorithm>
+
+constexpr unsigned Telemetry::n_slots;
+constexpr int Telemetry::n_buckets;
+
+Telemetry::Telemetry(std::vector<std::string> counter_names, std::vector<std::string> histogram_names) :
+    counter_names(std::move(counter_names)), histogram_names(std::move(histogram_names)) {
+    stride = this->counter_names.size() + this->histogram_names.size() * (n_buckets + 2);
+    stride = (stride + 7) / 8 * 8; // slots of different threads do not share cache lines
+    values.reset(new std::atomic<uint64_t>[n_slots * stride]);
+    reset();
+}
+
+unsigned Telemetry::get_thread_slot() {
+    static std::atomic<unsigned> next_slot{0};
+    thread_local unsigned slot = next_slot.fetch_add(1) % n_slots;
+    return slot;
+}
+
+void Telemetry::record(int histogram, uint64_t value) {
+    std::atomic<uint64_t> *h = &values[get_thread_slot() * stride + counter_names.size() + histogram * (n_buckets + 2)];
+    int bucket = value == 0 ? 0 : std::min(64 - __builtin_clzll(value), n_buckets - 1);
+    h[bucket].fetch_add(1, std::memory_order_relaxed);
+    h[n_buckets].fetch_add(value, std::memory_order_relaxed);
+    // only this thread writes the max of its slot, unless threads share a slot
+    uint64_t max = h[n_buckets + 1].load(std::memory_order_relaxed);
+    while (value > max && !h[n_buckets + 1].compare_exchange_weak(max, value, std::memory_order_relaxed)) { }
+}
+
+std::map<std::string, double> Telemetry::snapshot() const {
+    std::map<std::string, double> res;
+    for (size_t c = 0; c < counter_names.size(); ++c) {
+        uint64_t sum = 0;
+        for (unsigned s = 0; s < n_slots; ++s) {
+            sum += values[s * stride + c].load(std::memory_order_relaxed);
+        }
+        res[counter_names[c]] = static_cast<double>(sum);
+    }
+    for (size_t k = 0; k < histogram_names.size(); ++k) {
+        uint64_t buckets[n_buckets] = {0};
+        uint64_t count = 0, sum = 0, max = 0;
+        for (unsigned s = 0; s < n_slots; ++s) {
+            const std::atomic<uint64_t> *h = &values[s * stride + counter_names.size() + k * (n_buckets + 2)];
+            for (int b = 0; b < n_buckets; ++b) {
+                uint64_t x = h[b].load(std::memory_order_relaxed);
+                buckets[b] += x;
+                count += x;
+            }
+            sum += h[n_buckets].load(std::memory_order_relaxed);
+            max = std::max(max, h[n_buckets + 1].load(std::memory_order_relaxed));
+        }
+        auto percentile = [&](double q) {
+            uint64_t target = static_cast<uint64_t>(q * count), seen = 0;
+            for (int b = 0; b < n_buckets; ++b) {
+                seen += buckets[b];
+                if (seen > target) {
+                    return std::min(static_cast<double>(b == 0 ? 0 : uint64_t(1) << b), static_cast<double>(max));
+                }
+            }
+            return static_cast<double>(max);
+        };
+        const std::string &name = histogram_names[k];
+        res[name + ".count"] = static_cast<double>(count);
+        res[name + ".mean"] = count == 0 ? 0.0 : static_cast<double>(sum) / count;
+        res[name + ".p50"] = percentile(0.5);
+        res[name + ".p90"] = percentile(0.9);
+        res[name + ".p99"] = percentile(0.99);
+        res[name + ".max"] = static_cast<double>(max);
+    }
+    return res;
+}
+
+void Telemetry::reset() {
+    for (size_t i = 0; i < n_slots * stride; ++i) {
+        values[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void TraceRecorder::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+    origin = std::chrono::steady_clock::now();
+    enabled.store(true);
+}
+
+void TraceRecorder::add(const char *name, time_point begin, time_point end) {
+    if (!get_is_enabled()) {
+        return;
+    }
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    Event event{name, Telemetry::get_thread_slot(),
+        duration_cast<microseconds>(begin - origin).count(), duration_cast<microseconds>(end - begin).count()};
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(event);
+}
+
+bool TraceRecorder::write(const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const Event &e = events[i];
+        out << (i == 0 ? "" : ",") << "\n{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.tid
+            << ",\"ts\":" << e.ts << ",\"dur\":" << e.dur << "}";
+    }
+    out << "\n]}\n";
+    events.clear();
+    return static_cast<bool>(out);
+}
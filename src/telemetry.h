@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+/*
+    low-overhead counters and histograms
+    every thread adds to its own slot with relaxed atomics, a snapshot sums all slots
+    histograms have power-of-two buckets, so percentiles are reported as bucket upper bounds
+*/
+class Telemetry {
+public:
+    static constexpr unsigned n_slots = 64;     // threads beyond this share slots
+    static constexpr int n_buckets = 40;        // bucket b holds values in [2^(b-1), 2^b)
+
+    Telemetry(std::vector<std::string> counter_names, std::vector<std::string> histogram_names);
+
+    void add(int counter, uint64_t value = 1) {
+        values[get_thread_slot() * stride + counter].fetch_add(value, std::memory_order_relaxed);
+    }
+    void record(int histogram, uint64_t value);
+
+    /*
+        counters by name, and for each histogram
+        name.count, name.mean, name.p50, name.p90, name.p99 and name.max
+    */
+    std::map<std::string, double> snapshot() const;
+    void reset();
+
+    // small per-thread id, also used as thread id in traces
+    static unsigned get_thread_slot();
+private:
+    std::vector<std::string> counter_names;
+    std::vector<std::string> histogram_names;
+    size_t stride;  // values per slot: counters, then n_buckets + sum + max per histogram
+    std::unique_ptr<std::atomic<uint64_t>[]> values;
+};
+
+/*
+    collects complete events of the chrome trace-event format (chrome://tracing, perfetto)
+    recording is off until start(), events are kept in memory until write()
+*/
+class TraceRecorder {
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    void start();
+    void stop() { enabled.store(false); }
+    bool get_is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // name must outlive the recorder, string literals are expected
+    void add(const char *name, time_point begin, time_point end);
+    // write the events as json and drop them
+    bool write(const std::string &path);
+private:
+    struct Event {
+        const char *name;
+        unsigned tid;
+        int64_t ts;   // us since start()
+        int64_t dur;  // us
+    };
+
+    std::atomic<bool> enabled{false};
+    time_point origin;
+    std::mutex mutex;
+    std::vector<Event> events;
+};
@@ -1,38 +1,46 @@
 #pragma once
 #include <vector>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <type_traits>
+#include <cstdint>
 
 /*
-    A simple thread pool with c++11
+    A work-stealing thread pool with c++11
+    every worker owns a deque of tasks and steals from the others when its own is empty
+    parallel_for runs a bulk job without any allocation: the job lives on the caller's stack,
+    each worker owns a range of iterations and idle workers steal half of another's range
 */
 class ThreadPool {
 public:
     using task_type = std::function<void()>;
 
-    ThreadPool(size_t thread_num) : stop(false) {
-        for (int i = 0; i < thread_num; ++i) {
-            workers.emplace_back([this]() {
+    ThreadPool(size_t thread_num) : stop(false), queues(thread_num), ranges(new std::atomic<uint64_t>[thread_num]) {
+        for (size_t i = 0; i < thread_num; ++i) {
+            queues[i].reset(new Queue());
+            ranges[i].store(0);
+        }
+        for (size_t i = 0; i < thread_num; ++i) {
+            workers.emplace_back([this, i]() {
                 while (true) {
-                    task_type task;
-                    {
-                        std::unique_lock<std::mutex> lock(queue_mutex);
-                        task_cv.wait(lock, [this]() {
-                            return stop || !tasks.empty();
-                        });
-                        if (stop && tasks.empty()) {
-                            return;
-                        }
-                        task = std::move(tasks.front());
-                        tasks.pop();
+                    uint64_t seen = epoch.load();
+                    if (run_one(i)) {
+                        continue;
+                    }
+                    std::unique_lock<std::mutex> lock(sleep_mutex);
+                    if (stop && n_queued.load() == 0) {
+                        return;
                     }
-                    task();
+                    sleep_cv.wait(lock, [this, seen]() {
+                        return stop || epoch.load() != seen;
+                    });
                 }
             });
         }
@@ -45,34 +53,238 @@ public:
             std::bind(std::forward<F>(f), std::forward<Args>(args)...)
         );
         std::future<return_type> res = task->get_future();
+        if (stop) {
+            throw std::runtime_error("commit on stopped ThreadPool");
+        }
+        if (queues.empty()) {
+            (*task)();
+            return res;
+        }
+        Queue &queue = *queues[next_queue++ % queues.size()];
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            if (stop) {
-                throw std::runtime_error("commit on stopped ThreadPool");
-            }
-            tasks.emplace([task]() {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.emplace_back([task]() {
                 (*task)();
             });
-            task_cv.notify_one();
-            return res;
+        }
+        ++n_queued;
+        wake(false);
+        return res;
+    }
+
+    /*
+        run f(i) for every i in [0, n) on the workers and return when all are done
+        if f returns bool, returning false cancels the iterations not started yet
+        only one bulk job runs at a time, concurrent callers are serialized
+    */
+    template <class F>
+    void parallel_for(size_t n, F &&f) {
+        using func_type = typename std::remove_reference<F>::type;
+        if (n == 0) {
+            return;
+        }
+        if (workers.empty()) {
+            for (size_t i = 0; i < n; ++i) {
+                if (!call(f, i, std::is_same<decltype(f(i)), bool>())) {
+                    break;
+                }
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> guard(bulk_mutex);
+        BulkJob job;
+        job.ctx = &f;
+        job.invoke = [](void *ctx, size_t i) {
+            return call(*static_cast<func_type*>(ctx), i,
+                std::is_same<decltype(std::declval<func_type&>()(i)), bool>());
+        };
+        job.remaining.store(n);
+        job.cancelled.store(false);
+        size_t k = workers.size();
+        for (size_t i = 0; i < k; ++i) { // split [0, n) evenly
+            ranges[i].store(pack_range(n * i / k, n * (i + 1) / k));
+        }
+        bulk.store(&job);
+        wake(true);
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.cv.wait(lock, [&job]() {
+                return job.remaining.load() == 0;
+            });
+        }
+        // no worker may still hold a pointer to the job once it leaves this scope
+        bulk.store(nullptr);
+        while (bulk_users.load() > 0) {
+            std::this_thread::yield();
         }
     }
 
+    size_t get_thread_num() const { return workers.size(); }
+
     ~ThreadPool() {
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
+            std::unique_lock<std::mutex> lock(sleep_mutex);
             stop = true;
+            ++epoch;
         }
-        task_cv.notify_all();
+        sleep_cv.notify_all();
         // wait for all threads
         for (std::thread &worker : workers) {
             worker.join();
         }
     }
 private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<task_type> tasks;
+    };
+
+    struct BulkJob {
+        bool (*invoke)(void *ctx, size_t i);
+        void *ctx;
+        std::atomic<size_t> remaining;
+        std::atomic<bool> cancelled;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    template <class F>
+    static bool call(F &f, size_t i, std::true_type) { return f(i); }
+    template <class F>
+    static bool call(F &f, size_t i, std::false_type) { f(i); return true; }
+
+    // a range [begin, end) of iterations packed in one word
+    static uint64_t pack_range(uint64_t begin, uint64_t end) { return (begin << 32) | end; }
+
+    void wake(bool all) {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            ++epoch;
+        }
+        if (all) {
+            sleep_cv.notify_all();
+        }
+        else {
+            sleep_cv.notify_one();
+        }
+    }
+
+    // own queue from the front, other queues from the back
+    bool pop_task(size_t id, task_type &task) {
+        for (size_t k = 0; k < queues.size(); ++k) {
+            Queue &queue = *queues[(id + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.tasks.empty()) {
+                if (k == 0) {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                else {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // take the first iteration of the own range
+    bool take_iteration(size_t id, size_t &i) {
+        uint64_t range = ranges[id].load();
+        while (true) {
+            uint64_t begin = range >> 32, end = range & 0xffffffffu;
+            if (begin >= end) {
+                return false;
+            }
+            if (ranges[id].compare_exchange_weak(range, pack_range(begin + 1, end))) {
+                i = begin;
+                return true;
+            }
+        }
+    }
+
+    // move the upper half of another worker's range into the own range
+    bool steal_range(size_t id) {
+        for (size_t k = 1; k < workers.size(); ++k) {
+            size_t victim = (id + k) % workers.size();
+            uint64_t range = ranges[victim].load();
+            while (true) {
+                uint64_t begin = range >> 32, end = range & 0xffffffffu;
+                if (begin >= end) {
+                    break;
+                }
+                uint64_t mid = begin + (end - begin) / 2;
+                if (ranges[victim].compare_exchange_weak(range, pack_range(begin, mid))) {
+                    ranges[id].store(pack_range(mid, end));
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /*
+        empty all ranges of a cancelled job, return the number of iterations dropped
+        a range in the middle of being stolen is dropped by the thief after its next iteration
+    */
+    size_t drain_ranges() {
+        size_t dropped = 0;
+        for (size_t k = 0; k < workers.size(); ++k) {
+            uint64_t range = ranges[k].exchange(0);
+            uint64_t begin = range >> 32, end = range & 0xffffffffu;
+            if (begin < end) {
+                dropped += end - begin;
+            }
+        }
+        return dropped;
+    }
+
+    bool run_one(size_t id) {
+        task_type task;
+        if (pop_task(id, task)) {
+            --n_queued;
+            task();
+            return true;
+        }
+        bool did = false;
+        ++bulk_users;
+        BulkJob *job = bulk.load();
+        if (job != nullptr) {
+            size_t i;
+            while (true) {
+                if (!take_iteration(id, i)) {
+                    if (steal_range(id)) {
+                        continue;
+                    }
+                    break;
+                }
+                size_t finished = 1;
+                if (job->cancelled.load() || !job->invoke(job->ctx, i)) {
+                    job->cancelled.store(true);
+                    finished += drain_ranges();
+                }
+                did = true;
+                if ((job->remaining -= finished) == 0) {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    job->cv.notify_all();
+                }
+            }
+        }
+        --bulk_users;
+        return did;
+    }
+
     std::vector<std::thread> workers;
-    std::queue<task_type> tasks;
-    std::mutex queue_mutex;
-    std::condition_variable task_cv;
-    bool stop;
-};
\ No newline at end of file
+    std::atomic<bool> stop;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<size_t> next_queue{0};
+    std::atomic<size_t> n_queued{0};
+    std::unique_ptr<std::atomic<uint64_t>[]> ranges;  // per worker range of the bulk job
+    std::mutex bulk_mutex;
+    std::atomic<BulkJob*> bulk{nullptr};
+    std::atomic<int> bulk_users{0};  // workers that may hold a pointer to the bulk job
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<uint64_t> epoch{0};    // advanced whenever new work is published
+};
@@ -0,0 +1,70 @@
+#include "transposition_table.h"
+
+constexpr uint32_t TranspositionTable::not_found;
+constexpr size_t TranspositionTable::bucket_size;
+
+/*
+    the number of buckets is rounded down to a power of two
+    so that the memory used never exceeds size_mb
+*/
+TranspositionTable::TranspositionTable(size_t size_mb) : n_buckets(1) {
+    size_t max_buckets = (size_mb << 20) / (sizeof(Entry) * bucket_size);
+    while (n_buckets * 2 <= max_buckets) {
+        n_buckets *= 2;
+    }
+    entries.reset(new Entry[n_buckets * bucket_size]);
+    for (size_t i = 0; i < n_buckets * bucket_size; ++i) {
+        entries[i].key.store(0, std::memory_order_relaxed);
+        entries[i].data.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint32_t TranspositionTable::probe(uint64_t hash) const {
+    const Entry *bucket = &entries[(hash & (n_buckets - 1)) * bucket_size];
+    for (size_t i = 0; i < bucket_size; ++i) {
+        uint64_t data = bucket[i].data.load(std::memory_order_acquire);
+        uint64_t key = bucket[i].key.load(std::memory_order_acquire);
+        if ((key ^ data) == hash && (data & 0xffff) == generation) {
+            return static_cast<uint32_t>(data >> 32);
+        }
+    }
+    return not_found;
+}
+
+void TranspositionTable::store(uint64_t hash, uint32_t node, int ply) {
+    Entry *bucket = &entries[(hash & (n_buckets - 1)) * bucket_size];
+    Entry *victim = nullptr;
+    int victim_ply = -1;
+    for (size_t i = 0; i < bucket_size; ++i) {
+        uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+        uint64_t key = bucket[i].key.load(std::memory_order_relaxed);
+        if ((key ^ data) == hash) { // same position, overwrite
+            victim = &bucket[i];
+            break;
+        }
+        if ((data & 0xffff) != generation) { // empty or stale
+            victim = &bucket[i];
+            victim_ply = 0x10000;
+        }
+        else if (victim_ply < 0x10000 && static_cast<int>((data >> 16) & 0xffff) > victim_ply) {
+            victim = &bucket[i];
+            victim_ply = static_cast<int>((data >> 16) & 0xffff);
+        }
+    }
+    uint64_t data = pack(node, ply, generation);
+    victim->data.store(data, std::memory_order_release);
+    victim->key.store(hash ^ data, std::memory_order_release);
+}
+
+/*
+    must not run concurrently with probe or store
+*/
+void TranspositionTable::clear() {
+    if (++generation == 0) { // wrapped around, entries from old generations may look valid again
+        for (size_t i = 0; i < n_buckets * bucket_size; ++i) {
+            entries[i].key.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+        generation = 1;
+    }
+}
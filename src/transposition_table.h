@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+/*
+    A fixed-size, lock-free transposition table from zobrist hash to tree node index
+    entries are grouped in buckets of 4 (one cache line), a bucket is picked by the low hash bits
+    a store writes data and then key ^ data, so a torn entry fails verification on probe
+    clear() is O(1), it only advances the generation that stored entries are tagged with
+*/
+class TranspositionTable {
+public:
+    static constexpr uint32_t not_found = ~0u;
+
+    TranspositionTable(size_t size_mb);
+
+    uint32_t probe(uint64_t hash) const;
+    // replacement: same position, then empty or stale entries, then the deepest entry
+    void store(uint64_t hash, uint32_t node, int ply);
+    void clear();
+
+    size_t get_capacity() const { return n_buckets * bucket_size; }
+private:
+    static constexpr size_t bucket_size = 4;
+
+    struct Entry {
+        std::atomic<uint64_t> key;   // hash ^ data
+        std::atomic<uint64_t> data;  // node: 32 | ply: 16 | generation: 16
+    };
+
+    static uint64_t pack(uint32_t node, int ply, uint16_t generation) {
+        return (uint64_t(node) << 32) | (uint64_t(ply & 0xffff) << 16) | generation;
+    }
+
+    std::unique_ptr<Entry[]> entries;
+    size_t n_buckets;
+    uint16_t generation = 1; // 0 marks an empty entry
+};
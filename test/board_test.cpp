@@ -0,0 +1,139 @@
+/*
+    the bitboard Board against the array scan it replaced, over random games of every board size
+    and line length, plus the argument checks of the constructor
+*/
+#include "check.h"
+#include "board.h"
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+/*
+    the board before bitboards: a 2d array, and after every move a scan of the four lines through it
+*/
+class ScanBoard {
+public:
+    ScanBoard(int n, int n_in_row) : n(n), n_in_row(n_in_row), states(n, std::vector<int>(n)) { }
+
+    void exec_move(int pos) {
+        int x = pos / n, y = pos % n;
+        states[x][y] = cur_player;
+        cur_player = -cur_player;
+        ++move_cnt;
+        const static int dir[4][2] = {
+            {0, 1}, {1, 0}, {1, 1}, {1, -1}
+        };
+        auto is_same = [&](int x, int y, int aim) {
+            return x >= 0 && x < n && y >= 0 && y < n && states[x][y] == aim;
+        };
+        for (int i = 0; i < 4; ++i) {
+            int len = 1, step = 1;
+            while (is_same(x + step * dir[i][0], y + step * dir[i][1], states[x][y])) {
+                ++step, ++len;
+            }
+            step = 1;
+            while (is_same(x - step * dir[i][0], y - step * dir[i][1], states[x][y])) {
+                ++step, ++len;
+            }
+            if (len >= n_in_row) {
+                result = std::make_pair(true, states[x][y]);
+                return;
+            }
+        }
+        result = {move_cnt == n * n, 0};
+    }
+
+    std::vector<int> get_moves() const {
+        std::vector<int> moves;
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                if (states[i][j] == 0) {
+                    moves.push_back(i * n + j);
+                }
+            }
+        }
+        return moves;
+    }
+
+    int n;
+    int n_in_row;
+    int cur_player = 1;
+    int move_cnt = 0;
+    std::pair<bool, int> result{false, 0};
+    std::vector<std::vector<int>> states;
+};
+
+void test_random_games() {
+    std::mt19937 rng(20240229);
+    int n_games = 0, n_wins = 0, n_ties = 0;
+    for (int n = 1; n <= BitBoard::max_n; ++n) {
+        for (int n_in_row = 1; n_in_row <= std::min(n, 6); ++n_in_row) {
+            for (int game = 0; game < 40; ++game) {
+                Board board(n, n_in_row);
+                ScanBoard scan(n, n_in_row);
+                std::vector<int> order(n * n);
+                for (int i = 0; i < n * n; ++i) {
+                    order[i] = i;
+                }
+                std::shuffle(order.begin(), order.end(), rng);
+                for (int pos : order) {
+                    CHECK(board.is_legal(pos));
+                    board.exec_move(pos);
+                    scan.exec_move(pos);
+                    CHECK(board.get_result() == scan.result);
+                    CHECK(board.get_cur_player() == scan.cur_player);
+                    CHECK(!board.is_legal(pos));
+                    if (scan.result.first) {
+                        break;
+                    }
+                }
+                CHECK(board.get_states() == scan.states);
+                CHECK(board.get_moves() == scan.get_moves());
+                ++n_games;
+                n_wins += scan.result.second != 0;
+                n_ties += scan.result.first && scan.result.second == 0;
+            }
+        }
+    }
+    // both outcomes must actually be covered
+    CHECK(n_wins > n_games / 2);
+    CHECK(n_ties > 0);
+}
+
+// lines ending at the edge must not wrap into the next row through the padding column
+void test_edges() {
+    int n = 6;
+    Board board(n, 4);
+    for (int pos : {4, 30, 5, 31, 6, 32}) { // x at (0, 4) (0, 5) (1, 0), o on the last row
+        board.exec_move(pos);
+    }
+    CHECK(!board.get_result().first);
+    board.exec_move(7); // x at (1, 1): four in a row only if (0, 4) (0, 5) wrapped around
+    CHECK(!board.get_result().first);
+}
+
+void test_arguments() {
+    auto throws = [](int n, int n_in_row) {
+        try {
+            Board board(n, n_in_row);
+        }
+        catch (const std::invalid_argument &) {
+            return true;
+        }
+        return false;
+    };
+    CHECK(throws(0, 1));
+    CHECK(throws(BitBoard::max_n + 1, 5));
+    CHECK(throws(9, 0));
+    CHECK(throws(9, 10));
+    CHECK(!throws(9, 9));
+    CHECK(!throws(1, 1));
+}
+
+int main() {
+    test_random_games();
+    test_edges();
+    test_arguments();
+    return test_failures();
+}
@@ -0,0 +1,23 @@
+import sys
+sys.path.append('..')
+sys.path.append('../build')
+from library import AlphaZero, NeuralNetwork, OpeningBook
+import config
+
+# build an opening book with the best model, then set config['opening_book'] to its path
+# usage: python build_book.py [max_plies] [num_sims] [min_prob]
+if __name__ == '__main__':
+    c = config.config
+    max_plies = int(sys.argv[1]) if len(sys.argv) > 1 else 4
+    num_sims = int(sys.argv[2]) if len(sys.argv) > 2 else c['num_mcts_sims'] * 10
+    min_prob = float(sys.argv[3]) if len(sys.argv) > 3 else 0.05
+
+    suffix = '.weights' if c['native_inference'] else '.pt'
+    network = NeuralNetwork('./models/best_checkpoint' + suffix, c['libtorch_use_gpu'], c['num_mcts_threads'])
+    player = AlphaZero(network, c['num_mcts_threads'], num_sims, c['c_puct'], c['c_virtual_loss'])
+    player.set_transposition_table_size(c['transposition_table_mb'])
+    player.set_node_budget(c['mcts_node_budget'])
+
+    path = './models/opening_{}x{}_{}.book'.format(c['n'], c['n'], c['n_in_row'])
+    size = OpeningBook.build(path, player, c['n'], c['n_in_row'], max_plies, min_prob)
+    print('{} positions written to {}'.format(size, path))
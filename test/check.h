@@ -0,0 +1,19 @@
+#pragma once
+#include <iostream>
+
+/*
+    assertions of the test programs, a failed check is reported with its line and counted,
+    and main returns test_failures(), so ctest sees any failure while every check still runs
+*/
+inline int &test_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            ++test_failures(); \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+        } \
+    } while (0)
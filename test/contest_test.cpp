@@ -0,0 +1,68 @@
+/*
+    the sequential probability ratio test of ContestEngine on fixed game counts,
+    reference values from the formulas in contest.cpp evaluated independently
+*/
+#include "check.h"
+#include "contest.h"
+#include <cmath>
+#include <stdexcept>
+
+bool near(double a, double b) {
+    return std::abs(a - b) < 1e-5;
+}
+
+// llr for wins, losses and draws, with the engine cleared first
+double llr(ContestEngine &engine, int wins, int losses, int draws) {
+    engine.clear();
+    engine.add_results(wins, losses, draws);
+    return engine.get_llr();
+}
+
+int main() {
+    // no games are played, so the engine needs no networks
+    ContestEngine engine(nullptr, nullptr, 9, 5, 1, 1, 100, 5, 3);
+
+    engine.set_sprt(0, 35, 0.05, 0.05);
+    CHECK(near(engine.get_llr_lower(), -2.944439));
+    CHECK(near(engine.get_llr_upper(), 2.944439));
+    CHECK(llr(engine, 0, 0, 0) == 0);
+    CHECK(engine.get_decision() == 0);
+    CHECK(near(llr(engine, 60, 40, 0), 1.565360));
+    CHECK(engine.get_decision() == 0);
+    CHECK(near(llr(engine, 40, 60, 0), -2.614488));
+    CHECK(near(llr(engine, 50, 50, 0), -0.503995));
+    CHECK(near(llr(engine, 30, 20, 50), 1.009784));
+    CHECK(near(llr(engine, 0, 0, 10), -0.554395));
+    CHECK(near(llr(engine, 120, 80, 40), 3.479776));
+    CHECK(engine.get_decision() == 1);
+    // a streak is not an infinite llr, the variance is smoothed by half a win and half a loss
+    CHECK(near(llr(engine, 10, 0, 0), 5.494481));
+
+    // the gating test of config.py
+    engine.set_sprt(0, 200, 0.1, 0.1);
+    CHECK(near(engine.get_llr_lower(), -2.197225));
+    CHECK(near(llr(engine, 60, 40, 0), -3.230490));
+    CHECK(engine.get_decision() == -1);
+    CHECK(near(llr(engine, 10, 0, 0), 22.157804));
+    CHECK(engine.get_decision() == 1);
+
+    // results add up over calls, and the elo estimate follows the score
+    engine.clear();
+    engine.add_results(30, 20, 0);
+    engine.add_results(30, 20, 0);
+    CHECK(engine.get_n_games() == 100 && engine.get_wins() == 60 && engine.get_losses() == 40);
+    CHECK(near(engine.get_score(), 0.6));
+    CHECK(near(engine.get_elo(), 70.436504));
+    CHECK(near(engine.get_elo_lower(), 2.738262));
+    CHECK(near(engine.get_elo_upper(), 143.943039));
+
+    bool thrown = false;
+    try {
+        engine.add_results(-1, 0, 0);
+    }
+    catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    return test_failures();
+}
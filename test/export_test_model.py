@@ -0,0 +1,21 @@
+import os
+import sys
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'src'))
+import torch
+from neural_network import NeuralNetWorkWrapper
+
+# write a small 9x9 network of random weights as test_model.pt and test_model.weights, for native_network_test
+# usage: python export_test_model.py folder
+if __name__ == '__main__':
+    torch.manual_seed(0)
+    n = 9
+    wrapper = NeuralNetWorkWrapper(0.001, 0.0001, 2, 32, n, n * n)
+    # batch norms away from the identity, as after training, so folding them is tested too
+    with torch.no_grad():
+        for module in wrapper.neural_network.modules():
+            if isinstance(module, torch.nn.BatchNorm2d):
+                module.weight.uniform_(0.5, 1.5)
+                module.bias.uniform_(-0.5, 0.5)
+                module.running_mean.uniform_(-0.5, 0.5)
+                module.running_var.uniform_(0.5, 2.0)
+    wrapper.save_model(sys.argv[1], 'test_model')
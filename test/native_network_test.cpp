@@ -0,0 +1,108 @@
+/*
+    the native backend against torchscript on the same network, in float and int8,
+    and batched native runs against one board at a time
+    usage: native_network_test model
+    reads model.pt and model.weights as written by NeuralNetWorkWrapper.save_model, see export_test_model.py
+*/
+#include "check.h"
+#include "neural_network.h"
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+struct Output {
+    std::vector<float> prob;
+    float value;
+};
+
+// one board at a time, so every batch holds a single board
+std::vector<Output> evaluate(NeuralNetwork &network, const std::vector<Board> &boards) {
+    std::vector<Output> res;
+    for (const Board &board : boards) {
+        auto evaluation = network.evaluate(board);
+        const float *prob = evaluation.get_prob();
+        res.push_back(Output{std::vector<float>(prob, prob + board.get_board_size()), evaluation.get_value()});
+    }
+    return res;
+}
+
+// from threads at once, so boards share batches
+std::vector<Output> evaluate_batched(NeuralNetwork &network, const std::vector<Board> &boards, unsigned n_threads) {
+    std::vector<Output> res(boards.size());
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < boards.size(); i += n_threads) {
+                auto evaluation = network.evaluate(boards[i]);
+                const float *prob = evaluation.get_prob();
+                res[i] = Output{std::vector<float>(prob, prob + boards[i].get_board_size()), evaluation.get_value()};
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    return res;
+}
+
+// largest difference of a probability and of a value
+std::pair<float, float> max_diff(const std::vector<Output> &a, const std::vector<Output> &b) {
+    float prob_diff = 0, value_diff = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = 0; j < a[i].prob.size(); ++j) {
+            prob_diff = std::max(prob_diff, std::abs(a[i].prob[j] - b[i].prob[j]));
+        }
+        value_diff = std::max(value_diff, std::abs(a[i].value - b[i].value));
+    }
+    return std::make_pair(prob_diff, value_diff);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: native_network_test model" << std::endl;
+        return 1;
+    }
+    std::string model = argv[1];
+    NeuralNetwork reference(model + ".pt", false, 8);
+    NeuralNetwork native(model + ".weights", false, 8);
+
+    // every position of random games on the 9x9 board of export_test_model.py, from the empty board on
+    std::mt19937 rng(11);
+    std::vector<Board> boards;
+    for (int game = 0; game < 8; ++game) {
+        Board board(9, 5);
+        while (!board.get_result().first) {
+            boards.push_back(board);
+            auto moves = board.get_moves();
+            board.exec_move(moves[rng() % moves.size()]);
+        }
+    }
+    std::cout << boards.size() << " positions" << std::endl;
+
+    auto expected = evaluate(reference, boards);
+    auto diff = max_diff(evaluate(native, boards), expected);
+    std::cout << "float: max prob diff " << diff.first << ", max value diff " << diff.second << std::endl;
+    CHECK(diff.first < 1e-4f && diff.second < 1e-4f);
+
+    // the batched tower must not mix boards, padding columns included
+    auto single = evaluate(native, boards);
+    native.reset_batch_stats();
+    diff = max_diff(evaluate_batched(native, boards, 8), single);
+    std::cout << "batched: avg batch size " << native.get_avg_batch_size() << ", max prob diff " << diff.first
+        << ", max value diff " << diff.second << std::endl;
+    CHECK(diff.first < 1e-5f && diff.second < 1e-5f);
+
+    // int8 keeps the heads in float, so it stays close, and batching does not change its per-board scales
+    native.set_quantized(true);
+    auto quantized = evaluate(native, boards);
+    diff = max_diff(quantized, expected);
+    std::cout << "int8: max prob diff " << diff.first << ", max value diff " << diff.second << std::endl;
+    CHECK(diff.first < 0.05f && diff.second < 0.05f);
+    diff = max_diff(evaluate_batched(native, boards, 8), quantized);
+    CHECK(diff.first < 1e-5f && diff.second < 1e-5f);
+    return test_failures();
+}
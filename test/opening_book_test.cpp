@@ -0,0 +1,97 @@
+/*
+    an opening book built from a network of random weights answers every position it searched,
+    in any orientation, with the distribution the search produced
+*/
+#include "check.h"
+#include "random_weights.h"
+#include "opening_book.h"
+#include "mcts.h"
+#include "symmetry.h"
+#include <vector>
+#include <string>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+bool same_probs(const std::vector<double> &a, const std::vector<double> &b) {
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::abs(a[i] - b[i]) > 0.5 / 65535 + 1e-9) {
+            return false;
+        }
+    }
+    return a.size() == b.size();
+}
+
+int main() {
+    int n = 5, n_in_row = 4, max_plies = 2, n_playout = 200;
+    std::string weights = write_random_weights(n, 1, 8);
+    std::string path = weights + ".book";
+    {
+        // one search thread and no cache, so searching a position again repeats it exactly
+        NeuralNetwork network(weights, false, 1);
+        AlphaZero player(&network, 1, n_playout, 5, 3);
+        size_t n_positions = OpeningBook::build(path, player, n, n_in_row, max_plies, 0.02);
+        OpeningBook book(path);
+        CHECK(book.size() == n_positions);
+        CHECK(book.get_n() == n && book.get_n_in_row() == n_in_row);
+
+        Board empty(n, n_in_row);
+        std::vector<double> probs;
+        CHECK(book.lookup(empty, probs));
+        CHECK(std::abs(std::accumulate(probs.begin(), probs.end(), 0.0) - 1.0) < 1e-3);
+        AlphaZero fresh(&network, 1, n_playout, 5, 3);
+        CHECK(same_probs(probs, fresh.get_action_probs(empty, 1.0)));
+
+        // every followed reply is in the book, under all symmetries, in the orientation of the lookup
+        int n_followed = 0;
+        for (int action = 0; action < n * n; ++action) {
+            if (probs[action] < 0.02) {
+                continue;
+            }
+            ++n_followed;
+            Board next = empty;
+            next.exec_move(action);
+            std::vector<double> next_probs;
+            CHECK(book.lookup(next, next_probs));
+            for (int t = 0; t < Symmetry::n_symmetries; ++t) {
+                int sym_action = Symmetry::get_table(n, t)[action];
+                Board sym = empty;
+                sym.exec_move(sym_action);
+                std::vector<double> sym_probs, expected(n * n);
+                CHECK(book.lookup(sym, sym_probs));
+                // a move on an axis leaves the board unchanged under some symmetries, any of them may be stored
+                bool matched = false;
+                for (int u = 0; u < Symmetry::n_symmetries && !matched; ++u) {
+                    const auto &table = Symmetry::get_table(n, u);
+                    if (table[action] != sym_action) {
+                        continue;
+                    }
+                    for (int pos = 0; pos < n * n; ++pos) {
+                        expected[table[pos]] = next_probs[pos];
+                    }
+                    matched = same_probs(sym_probs, expected);
+                }
+                CHECK(matched);
+            }
+        }
+        CHECK(n_followed > 0);
+
+        // deeper than max_plies
+        Board deep = empty;
+        for (int pos : {0, 1, 2}) {
+            deep.exec_move(pos);
+        }
+        CHECK(!book.lookup(deep, probs));
+
+        // a search answers book positions from the book
+        AlphaZero booked(&network, 1, n_playout, 5, 3);
+        booked.set_opening_book(&book);
+        book.lookup(empty, probs);
+        CHECK(booked.get_action(empty) == std::max_element(probs.begin(), probs.end()) - probs.begin());
+        CHECK(booked.get_stats()["book_hits"] == 1);
+    }
+    std::remove(path.c_str());
+    std::remove(weights.c_str());
+    return test_failures();
+}
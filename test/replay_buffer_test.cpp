@@ -0,0 +1,130 @@
+/*
+    examples written to a ReplayBuffer come back from sample, exactly for states and values and
+    up to the 16-bit quantization for policies, also after the file is reopened and under symmetries
+*/
+#include "check.h"
+#include "replay_buffer.h"
+#include "symmetry.h"
+#include "board.h"
+#include <vector>
+#include <string>
+#include <random>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct Example {
+    std::vector<float> state;
+    std::vector<float> prob;
+    float value;
+};
+
+// positions along one random game, with a random policy over the legal moves
+std::vector<Example> make_examples(int n, int k, std::mt19937 &rng) {
+    std::vector<Example> examples;
+    Board board(n, n);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (int i = 0; i < k; ++i) {
+        Example example{board.get_encode_states(), std::vector<float>(n * n, 0.0f), static_cast<float>(i % 3 - 1)};
+        float sum = 0;
+        for (int action : board.get_moves()) {
+            example.prob[action] = uniform(rng);
+            sum += example.prob[action];
+        }
+        for (auto &p : example.prob) {
+            p /= sum;
+        }
+        examples.push_back(example);
+        auto moves = board.get_moves();
+        board.exec_move(moves[rng() % moves.size()]);
+    }
+    return examples;
+}
+
+void append(ReplayBuffer &buffer, const std::vector<Example> &examples, size_t begin, size_t end) {
+    std::vector<float> states, probs, values;
+    for (size_t i = begin; i < end; ++i) {
+        states.insert(states.end(), examples[i].state.begin(), examples[i].state.end());
+        probs.insert(probs.end(), examples[i].prob.begin(), examples[i].prob.end());
+        values.push_back(examples[i].value);
+    }
+    buffer.append(states, probs, values);
+}
+
+bool same_prob(const float *a, const float *b, int size) {
+    for (int i = 0; i < size; ++i) {
+        if (std::abs(a[i] - b[i]) > 0.5f / 65535 + 1e-6f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    every sampled example must be one of candidates, under one of the symmetries if augment is set,
+    return how many samples matched
+*/
+size_t count_matches(ReplayBuffer &buffer, const std::vector<Example> &candidates, int n, bool augment) {
+    int size = n * n;
+    buffer.sample(200, augment);
+    const auto &states = buffer.get_batch_states();
+    const auto &probs = buffer.get_batch_probs();
+    const auto &values = buffer.get_batch_values();
+    std::vector<float> state(4 * size), prob(size);
+    size_t n_matched = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        bool matched = false;
+        for (const auto &example : candidates) {
+            for (int t = 0; t < (augment ? Symmetry::n_symmetries : 1) && !matched; ++t) {
+                Symmetry::transform(n, t, example.state.data(), 4, state.data());
+                Symmetry::transform(n, t, example.prob.data(), 1, prob.data());
+                matched = std::equal(state.begin(), state.end(), states.begin() + i * 4 * size)
+                    && same_prob(prob.data(), probs.data() + i * size, size) && values[i] == example.value;
+            }
+        }
+        n_matched += matched;
+    }
+    return n_matched;
+}
+
+int main() {
+    int n = 7;
+    size_t capacity = 16;
+    char path[] = "/tmp/replay_buffer_test_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    std::mt19937 rng(3);
+    auto examples = make_examples(n, 20, rng);
+    std::vector<Example> kept(examples.end() - capacity, examples.end());
+    {
+        ReplayBuffer buffer(path, n, capacity);
+        CHECK(buffer.size() == 0);
+        append(buffer, examples, 0, 10);
+        CHECK(buffer.size() == 10);
+        append(buffer, examples, 10, 20); // wraps, the first 4 are overwritten
+        CHECK(buffer.size() == capacity);
+        CHECK(count_matches(buffer, kept, n, false) == 200);
+        CHECK(count_matches(buffer, std::vector<Example>(examples.begin(), examples.begin() + 4), n, false) == 0);
+        CHECK(count_matches(buffer, kept, n, true) == 200);
+        buffer.flush();
+    }
+    {
+        ReplayBuffer buffer(path, n, capacity);
+        CHECK(buffer.size() == capacity);
+        CHECK(count_matches(buffer, kept, n, false) == 200);
+    }
+    bool thrown = false;
+    try {
+        ReplayBuffer buffer(path, n, capacity + 1);
+    }
+    catch (const std::runtime_error &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    std::remove(path);
+    return test_failures();
+}
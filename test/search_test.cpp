@@ -0,0 +1,130 @@
+/*
+    search with and without the transposition table, which turns the tree into a DAG:
+    both must agree on forced wins and blocks, and search identically while no transposition is met
+*/
+#include "check.h"
+#include "mcts.h"
+#include <vector>
+#include <string>
+#include <random>
+#include <stdexcept>
+
+/*
+    a deterministic evaluator: uniform priors over the legal moves and a small value derived from the
+    position hash, so transposed positions get the same value and single-threaded searches repeat exactly
+*/
+class HashMCTS : public MCTS {
+public:
+    using MCTS::MCTS;
+
+    std::pair<std::vector<double>, double> policy(Board &board) override {
+        auto actions = board.get_moves();
+        std::vector<double> action_priors(board.get_board_size(), 0.0);
+        for (int action : actions) {
+            action_priors[action] = 1.0 / actions.size();
+        }
+        uint64_t h = board.get_hash() * 0x9e3779b97f4a7c15ull;
+        return std::make_pair(action_priors, (static_cast<int>((h >> 40) % 201) - 100) / 1000.0);
+    }
+};
+
+Board play(int n, int n_in_row, const std::vector<int> &moves) {
+    Board board(n, n_in_row);
+    for (int pos : moves) {
+        board.exec_move(pos);
+    }
+    return board;
+}
+
+/*
+    on 6x6 with four in a row, x has three on row 2 with only (2, 3) open
+    x to move must take it, o to move must block it, the opponent's other moves are spread out
+*/
+void test_tactics() {
+    int n = 6;
+    Board win = play(n, 4, {12, 35, 13, 30, 14, 0});
+    Board block = play(n, 4, {12, 35, 13, 30, 14});
+    for (size_t table_mb : {0, 16}) {
+        for (size_t threads : {1, 4}) {
+            HashMCTS mcts(threads, 20000, 5, 3);
+            mcts.set_early_stop(false); // searched, not answered by the forced move rule
+            mcts.set_transposition_table_size(table_mb);
+            CHECK(mcts.get_action(win) == 15);
+            mcts.update_with_move(-1);
+            CHECK(mcts.get_action(block) == 15);
+            auto stats = mcts.get_stats();
+            CHECK(table_mb == 0 ? stats["transpositions"] == 0 : stats["transpositions"] > 0);
+        }
+    }
+}
+
+/*
+    a search that meets no transposition must not differ from a plain tree search,
+    shallow searches of random positions meet none in most cases
+*/
+void test_same_without_transpositions() {
+    std::mt19937 rng(7);
+    int n_compared = 0;
+    for (int round = 0; round < 40; ++round) {
+        Board board(9, 5);
+        for (int i = 0; i < 6; ++i) {
+            auto moves = board.get_moves();
+            board.exec_move(moves[rng() % moves.size()]);
+        }
+        HashMCTS tree(1, 60, 5, 3), dag(1, 60, 5, 3);
+        tree.set_early_stop(false);
+        dag.set_early_stop(false);
+        dag.set_transposition_table_size(16);
+        int tree_action = tree.get_action(board), dag_action = dag.get_action(board);
+        auto tree_stats = tree.get_stats(), dag_stats = dag.get_stats();
+        if (dag_stats["transpositions"] > 0) {
+            continue;
+        }
+        ++n_compared;
+        CHECK(tree_action == dag_action);
+        CHECK(tree_stats["expansions"] == dag_stats["expansions"]);
+        CHECK(tree_stats["terminals"] == dag_stats["terminals"]);
+    }
+    CHECK(n_compared > 0);
+}
+
+// a game with tree reuse through the table, every move must be legal until the game ends
+void test_game() {
+    for (size_t table_mb : {0, 16}) {
+        HashMCTS mcts(4, 2000, 5, 3);
+        mcts.set_transposition_table_size(table_mb);
+        mcts.set_node_budget(20000);
+        Board board(8, 5);
+        while (!board.get_result().first) {
+            int action = mcts.get_action(board);
+            CHECK(board.is_legal(action));
+            if (!board.is_legal(action)) {
+                break;
+            }
+            board.exec_move(action);
+            mcts.update_with_move(action);
+        }
+    }
+}
+
+void test_no_moves() {
+    Board tie = play(3, 3, {0, 1, 2, 4, 3, 5, 7, 6, 8});
+    CHECK(tie.get_result() == std::make_pair(true, 0));
+    HashMCTS mcts(1, 100, 5, 3);
+    bool thrown = false;
+    try {
+        mcts.get_action(tie);
+    }
+    catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main() {
+    test_tactics();
+    test_same_without_transpositions();
+    test_game();
+    test_no_moves();
+    return test_failures();
+}